@@ -1,6 +1,9 @@
 /*
  * Read output from photodiode via boxcar at SR245 port #1.
  *
+ * The shots are averaged with the SR245 scan mode: the samples are
+ * streamed in binary as the triggers arrive instead of one query per shot.
+ *
  */
 
 #include <stdio.h>
@@ -12,9 +15,19 @@
 
 #define MD 655350
 
+/* Add up the samples of one scan */
+static int sum(double *vals, int n, int offset, void *arg) {
+
+  int i;
+
+  for (i = 0; i < n; i++)
+    *((double *) arg) += vals[i];
+  return 0;
+}
+
 int main(int argc, char **argv) {
 
-  int i, j, loop_amt;
+  int i, loop_amt, port = 1;
   char buf[2048];
   double xval[MD], yval[MD];
   char graphix;
@@ -42,10 +55,7 @@ int main(int argc, char **argv) {
     meas_misc_set_time();
     xval[i] = i;
     yval[i] = 0.0;
-    meas_sr245_enable_trigger(0);
-    for (j = 0; j < loop_amt; j++)
-      yval[i] += meas_sr245_read(0, 1); /* From port #1 */
-    meas_sr245_disable_trigger(0);
+    meas_sr245_scan_stream(0, &port, 1, loop_amt, sum, &yval[i]); /* From port #1 */
     yval[i] /= (double) loop_amt;
     if(graphix == 'y')
       meas_graphics_update_xy(0, xval, yval, i+1);
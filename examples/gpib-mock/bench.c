@@ -0,0 +1,166 @@
+/*
+ * Driver throughput against simulated GPIB instruments (no hardware
+ * needed; libmeas must be built with GPIB=MOCK in make.conf).
+ *
+ * The simulated instruments answer immediately, so the calls per second
+ * measure the overhead of the drivers and the GPIB layer alone. The number
+ * of bus messages the instrument received per call is printed as well.
+ *
+ * Usage: bench [calls] [script]
+ *
+ * Without a script, the replies below are used (see src/mock-gpib.c for
+ * the script format; the addresses must be the same as below).
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <meas/meas.h>
+
+#define BOARD 0
+#define HP34401A 22
+#define SR810    8
+#define TDS      1
+#define TDS_LONG 2
+#define TDS_FRAMES 3
+#define BNC565   12
+
+#define TDS_POINTS 2500
+#define TDS_LONG_POINTS 1000000
+#define TDS_FRAME_POINTS 500
+#define TDS_NFRAMES 100
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+/* CURVE? reply for nsrc sources of points 2 byte samples each */
+static void curve_rule(int pad, int points, int nsrc) {
+
+  char *curve, digits[16];
+  int i, j, len = 0;
+
+  if(!(curve = (char *) malloc(nsrc * (32 + 2 * points)))) exit(1);
+  sprintf(digits, "%d", 2 * points);
+  for (j = 0; j < nsrc; j++) {
+    len += sprintf(curve + len, "%s:CURVE #%d%s", (j ? ";" : ""), (int) strlen(digits), digits);
+    for (i = 0; i < 2 * points; i++)
+      curve[len++] = (char) i;
+  }
+  curve[len++] = '\n';
+  meas_mock_gpib_rule(pad, "CURVE?", 0.0, curve, len);
+  free(curve);
+}
+
+static void script() {
+
+  meas_mock_gpib_rule(HP34401A, "READ?", 0.0, "+1.23456789E+00\n", 16);
+  meas_mock_gpib_rule(HP34401A, "MEAS?", 0.0, "+1.23456789E+00\n", 16);
+  meas_mock_gpib_rule(SR810, "PHAS?", 0.0, "12.5\n", 5);
+  curve_rule(TDS, TDS_POINTS, 1);
+  meas_mock_gpib_rule(TDS, "WFMPRE:", 0.0, "4.0E-9;-5.0E-6;1250;1.5625E-4;0.0E0;0.0E0\n", 42);
+  curve_rule(TDS_LONG, TDS_LONG_POINTS, 1);
+  curve_rule(TDS_FRAMES, TDS_FRAME_POINTS * TDS_NFRAMES, 2);
+  meas_mock_gpib_rule(TDS_FRAMES, "WFMPRE:", 0.0, "4.0E-9;-5.0E-6;250;1.5625E-4;0.0E0;0.0E0\n", 41);
+}
+
+static void report(char *name, int pad, int n, double t0, long msgs) {
+
+  double t = now() - t0;
+
+  printf("%-10s %10.0lf calls/s %8.2lf us/call %6.2lf messages/call\n", name, n / t, 1E6 * t / n,
+	 ((double) (meas_mock_gpib_messages(pad) - msgs)) / n);
+}
+
+int main(int argc, char **argv) {
+
+  int i, n, fd;
+  long msgs;
+  double t0;
+  double *data, *times, *frames[2 * TDS_NFRAMES];
+
+  n = (argc > 1)?atoi(argv[1]):10000;
+  if(argc > 2) {
+    if(meas_mock_gpib_load(argv[2]) < 0) exit(1);
+  } else script();
+
+  meas_hp34401a_open(0, BOARD, HP34401A);
+  msgs = meas_mock_gpib_messages(HP34401A);
+  t0 = now();
+  for (i = 0; i < n; i++)
+    meas_hp34401a_read_auto(0);
+  report("hp34401a", HP34401A, n, t0, msgs);
+
+  meas_sr810_open(0, BOARD, SR810, NULL);
+  msgs = meas_mock_gpib_messages(SR810);
+  t0 = now();
+  for (i = 0; i < n; i++)
+    meas_sr810_get_refphase(0);
+  report("sr810", SR810, n, t0, msgs);
+
+  if(!(data = (double *) malloc(sizeof(double) * TDS_LONG_POINTS)) || !(times = (double *) malloc(sizeof(double) * TDS_POINTS))) exit(1);
+  fd = meas_gpib_open(BOARD, TDS);
+  meas_gpib_timeout(fd, 1.0);
+  meas_tds_init(fd, "CH1", TDS_POINTS, 1, TDS_POINTS, 2);
+  msgs = meas_mock_gpib_messages(TDS);
+  t0 = now();
+  for (i = 0; i < n; i++)
+    if(meas_tds_transfer(fd, data) != TDS_POINTS) {
+      fprintf(stderr, "tds: transfer failed.\n");
+      break;
+    }
+  report("tds", TDS, n, t0, msgs);
+  msgs = meas_mock_gpib_messages(TDS);
+  t0 = now();
+  for (i = 0; i < n; i++)
+    if(meas_tds_transfer_volts(fd, data, times) != TDS_POINTS) {
+      fprintf(stderr, "tds: volts transfer failed.\n");
+      break;
+    }
+  report("tds volts", TDS, n, t0, msgs);  /* preamble read once */
+
+  /* long records: fewer calls */
+  fd = meas_gpib_open(BOARD, TDS_LONG);
+  meas_gpib_timeout(fd, 1.0);
+  meas_tds_init(fd, "CH1", TDS_LONG_POINTS, 1, TDS_LONG_POINTS, 2);
+  msgs = meas_mock_gpib_messages(TDS_LONG);
+  t0 = now();
+  for (i = 0; i < n / 1000 + 1; i++)
+    if(meas_tds_transfer(fd, data) != TDS_LONG_POINTS) {
+      fprintf(stderr, "tds: long transfer failed.\n");
+      break;
+    }
+  report("tds 1M", TDS_LONG, n / 1000 + 1, t0, msgs);
+
+  /* FastFrame: two channels, one CURVE? for all frames (per trigger figures) */
+  for (i = 0; i < 2 * TDS_NFRAMES; i++)
+    frames[i] = data + i * TDS_FRAME_POINTS;
+  fd = meas_gpib_open(BOARD, TDS_FRAMES);
+  meas_gpib_timeout(fd, 1.0);
+  meas_tds_init(fd, "CH1,CH2", TDS_FRAME_POINTS, 1, TDS_FRAME_POINTS, 2);
+  meas_tds_fastframe(fd, TDS_NFRAMES);
+  meas_tds_transfer_frames(fd, frames, times);  /* reads the preambles */
+  msgs = meas_mock_gpib_messages(TDS_FRAMES);
+  t0 = now();
+  for (i = 0; i < n / TDS_NFRAMES + 1; i++)
+    if(meas_tds_transfer_frames(fd, frames, times) != TDS_FRAME_POINTS) {
+      fprintf(stderr, "tds: frame transfer failed.\n");
+      break;
+    }
+  report("tds frames", TDS_FRAMES, (n / TDS_NFRAMES + 1) * TDS_NFRAMES, t0, msgs);
+
+  meas_bnc565_open(0, BOARD, BNC565);
+  msgs = meas_mock_gpib_messages(BNC565);
+  t0 = now();
+  for (i = 0; i < n; i++)
+    meas_bnc565_set(0, MEAS_BNC565_CHA, MEAS_BNC565_T0, 1E-6 + 1E-9 * (i % 2), 1E-6, 5.0, MEAS_BNC565_POL_NORM);
+  report("bnc565", BNC565, n, t0, msgs);  /* only the delay changes */
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Several threads talking to their own simulated GPIB instruments at the
+ * same time, spread over NBOARDS boards (no hardware needed; libmeas must
+ * be built with GPIB=MOCK in make.conf). Transfers on one board are
+ * serialized by the board lock; those on different boards really overlap.
+ *
+ * Each thread sends commands of a different length and each instrument
+ * answers with a reply of a different length. Every fourth one never
+ * answers (its queries time out, which is reported on stderr), so a
+ * thread that saw the status or byte count of another thread's transfer
+ * would notice.
+ *
+ * Usage: threads [queries per thread]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <meas/meas.h>
+
+#define NBOARDS  4
+#define NTHREADS 8
+#define FIRST    1   /* GPIB address of the first instrument */
+
+static int nqueries;
+static int failures[NTHREADS];
+
+/* Reply of instrument i: i + 1 digits */
+static void reply(int i, char *buf) {
+
+  memset(buf, '0' + i, i + 1);
+  buf[i + 1] = 0;
+}
+
+static int silent(int i) {
+
+  return (i % 4) == 3;
+}
+
+static void *worker(void *arg) {
+
+  int i = (int) (long) arg, fd, n, len, queries;
+  char buf[64], want[64], cmd[64];
+
+  sprintf(cmd, "ID?%.*s", 4 * i, "XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX");
+  fd = meas_gpib_open(i % NBOARDS, FIRST + i);
+  meas_gpib_timeout(fd, silent(i)?1E-3:1.0);
+  reply(i, want);
+  queries = silent(i)?(nqueries / 100 + 1):nqueries;
+  for (n = 0; n < queries; n++) {
+    if(meas_gpib_write(fd, cmd, 1) < 0) {
+      failures[i]++;
+      continue;
+    }
+    if(silent(i)) {
+      if(meas_gpib_read_n(fd, buf, 4) == 0) failures[i]++;   /* must time out */
+    } else {
+      len = meas_gpib_read_max(fd, buf, sizeof(buf));
+      if(len != i + 1 || strcmp(buf, want)) failures[i]++;
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+
+  pthread_t th[NTHREADS];
+  char buf[64];
+  int i, total = 0;
+
+  nqueries = (argc > 1)?atoi(argv[1]):20000;
+  for (i = 0; i < NTHREADS; i++)
+    if(!silent(i)) {
+      reply(i, buf);
+      strcat(buf, "\n");
+      meas_mock_gpib_rule(FIRST + i, "ID?", 0.0, buf, strlen(buf));
+    }
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(&th[i], NULL, worker, (void *) (long) i);
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_join(th[i], NULL);
+    printf("thread %d (address %d%s): %d wrong replies\n", i, FIRST + i, silent(i)?", silent":"", failures[i]);
+    total += failures[i];
+  }
+  printf("%s\n", total?"FAILED":"OK");
+  return total?1:0;
+}
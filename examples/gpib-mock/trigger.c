@@ -0,0 +1,72 @@
+/*
+ * Synchronized sampling with Group Execute Trigger against simulated
+ * GPIB instruments (libmeas must be built with GPIB=MOCK in make.conf).
+ *
+ * UNITS HP34401A multimeters are set to wait for a bus trigger, triggered
+ * together with one GET and the readings are collected with the
+ * transaction engine. Each simulated meter takes DELAY seconds to answer,
+ * so collecting the readings one after another takes UNITS times as long.
+ *
+ * Usage: trigger [rounds]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <meas/meas.h>
+
+#define BOARD 0
+#define HP34401A 22   /* first address */
+#define UNITS 4
+#define DELAY 0.02
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+
+  int i, j, n, fds[UNITS], h[UNITS], status;
+  char reply[MEAS_GPIB_ENGINE_REPLYLEN];
+  double t0, val;
+
+  n = (argc > 1)?atoi(argv[1]):10;
+  for (i = 0; i < UNITS; i++) {
+    sprintf(reply, "+%d.00000000E+00\n", i + 1);
+    meas_mock_gpib_rule(HP34401A + i, "FETC?", DELAY, reply, 16);
+    meas_hp34401a_open(i, BOARD, HP34401A + i);
+    meas_hp34401a_set_trigger_source(i, MEAS_HP34401A_TRIGGER_BUS);
+    fds[i] = meas_hp34401a_fd(i);
+  }
+
+  t0 = now();
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < UNITS; i++)
+      meas_hp34401a_arm(i);
+    for (i = 0; i < UNITS; i++)
+      if(meas_hp34401a_fetch(i, &val) < 0) exit(1);
+  }
+  printf("sequential: %8.2lf ms/round\n", 1E3 * (now() - t0) / n);
+
+  t0 = now();
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < UNITS; i++)
+      meas_hp34401a_arm(i);
+    if(meas_gpib_trigger(fds, UNITS) < 0) exit(1);
+    for (i = 0; i < UNITS; i++)
+      h[i] = meas_gpib_engine_submit(fds[i], "FETC?", MEAS_HP34401A_CRLF, 1.0);
+    meas_gpib_engine_wait_all(-1.0);
+    for (i = 0; i < UNITS; i++) {
+      meas_gpib_engine_result(h[i], reply, &status);
+      if(j == n - 1) printf("unit %d (status %d): %s", i, status, reply);
+    }
+  }
+  printf("group:      %8.2lf ms/round\n", 1E3 * (now() - t0) / n);
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * DK240 monochromator driver against a simulated instrument on a pseudo
+ * terminal (no hardware needed).
+ *
+ * The child process answers GOTO, WAVEQ and ECHO like the DK240 does (echo,
+ * payload, status byte, EOT). The parent reads the wavelength first the
+ * way the driver used to (unbuffered reads, one per field, with privileges
+ * switched on and off around each) and then with meas_dk240_getwl() (one
+ * buffered frame read) and prints the system calls and time per command.
+ *
+ * Usage: dk240-bench [commands]
+ *
+ */
+
+#define _GNU_SOURCE   /* posix_openpt() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <meas/meas.h>
+
+static void instrument(int master) {
+
+  unsigned char c, wl[3] = {0, 0, 0}, buf[6];
+
+  while(read(master, &c, 1) == 1) {
+    buf[0] = c;
+    switch(c) {
+    case MEAS_DK240_ECHO:
+      write(master, buf, 1);
+      break;
+    case MEAS_DK240_WAVEQ:
+      memcpy(buf + 1, wl, 3);
+      buf[4] = 0;
+      buf[5] = MEAS_DK240_EOT;
+      write(master, buf, 6);
+      break;
+    case MEAS_DK240_GOTO:
+      write(master, buf, 1);
+      if(read(master, wl, 3) != 3) exit(0);
+      buf[0] = 0;
+      buf[1] = MEAS_DK240_EOT;
+      write(master, buf, 2);
+      break;
+    default:
+      buf[1] = 0;
+      buf[2] = MEAS_DK240_EOT;
+      write(master, buf, 3);
+    }
+  }
+  exit(0);
+}
+
+/* Read len bytes the way meas_rs232_read() used to (unbuffered, root on/off around it) */
+static long old_read(int fd, unsigned char *buf, int len) {
+
+  int n = 0;
+  long nsys = 0;
+
+  meas_misc_root_on();
+  while(n < len) {
+    n += read(fd, buf + n, len - n);
+    nsys++;
+  }
+  meas_misc_root_off();
+  return nsys;
+}
+
+/* This is how meas_dk240_getwl() used to work: one read per field. Returns # of read/write calls. */
+static long old_getwl(int fd) {
+
+  unsigned char buf[3], c = MEAS_DK240_WAVEQ;
+  long nsys = 1;
+
+  meas_misc_root_on();
+  write(fd, &c, 1);
+  meas_misc_root_off();
+  nsys += old_read(fd, buf, 1);
+  nsys += old_read(fd, buf, 3);
+  nsys += old_read(fd, buf, 1);  /* status */
+  nsys += old_read(fd, buf, 1);  /* EOT */
+  return nsys;
+}
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+
+  int master, fd, i, n;
+  pid_t pid;
+  long nsys;
+  double t0, wl;
+
+  n = (argc > 1)?atoi(argv[1]):10000;
+  if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    fprintf(stderr, "Can't open pty.\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0) instrument(master);
+  if(meas_dk240_open(0, ptsname(master)) < 0) exit(1);
+  meas_dk240_setwl(0, 700.25);
+
+  /* the driver keeps the descriptor to itself; open the pty a second time for the old reader */
+  fd = meas_rs232_open(ptsname(master), MEAS_B9600);
+  nsys = -meas_misc_root_transitions();
+  t0 = now();
+  for (i = 0; i < n; i++)
+    nsys += old_getwl(fd);
+  nsys += meas_misc_root_transitions();
+  printf("old:  %6.2lf syscalls/command, %8.2lf us/command\n", ((double) nsys) / n, 1E6 * (now() - t0) / n);
+  meas_rs232_close(fd);
+
+  nsys = meas_rs232_syscalls() + meas_misc_root_transitions();
+  t0 = now();
+  for (i = 0; i < n; i++)
+    wl = meas_dk240_getwl(0);
+  nsys = meas_rs232_syscalls() + meas_misc_root_transitions() - nsys;
+  printf("new:  %6.2lf syscalls/command, %8.2lf us/command (wavelength %.2lf nm)\n", ((double) nsys) / n, 1E6 * (now() - t0) / n, wl);
+
+  kill(pid, SIGTERM);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Request/response latency over a pseudo terminal (no hardware needed).
+ *
+ * The child process answers every request line immediately, so the measured
+ * round trip time is the software overhead of the library, the tty layer and
+ * the scheduler. With a real USB-serial adapter the latency timer of the
+ * adapter comes on top of this (16 ms by default on FTDI; see
+ * MEAS_LOWLATENCY).
+ *
+ * Usage: latency [requests] [device]
+ *
+ * If device is given, it is opened in low latency mode and the applied
+ * settings are printed (the instrument must answer "?\r" with a line).
+ *
+ */
+
+#define _GNU_SOURCE   /* posix_openpt() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <meas/meas.h>
+
+static void instrument(int master) {
+
+  char c;
+
+  while(read(master, &c, 1) == 1)
+    if(c == '\r') write(master, "+1.000E+00\r", 11);
+  exit(0);
+}
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b) {
+
+  double x = *(double *) a, y = *(double *) b;
+
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+
+  int master, fd, i, n, low_latency, latency_timer;
+  pid_t pid = 0;
+  double *t, t0;
+  char buf[512];
+
+  n = (argc > 1)?atoi(argv[1]):10000;
+  if(argc > 2) {
+    fd = meas_rs232_open(argv[2], MEAS_B9600 | MEAS_NOHANDSHAKE | MEAS_LOWLATENCY);
+  } else {
+    if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+      fprintf(stderr, "Can't open pty.\n");
+      exit(1);
+    }
+    fd = meas_rs232_open(ptsname(master), MEAS_B9600 | MEAS_NOHANDSHAKE | MEAS_LOWLATENCY);
+    if((pid = fork()) == 0) instrument(master);
+  }
+  if(fd < 0) exit(1);
+  meas_rs232_set_timeout(fd, 1.0);
+  meas_rs232_latency(fd, &low_latency, &latency_timer);
+  printf("ASYNC_LOW_LATENCY: %s, latency timer: ", (low_latency == 1)?"set":"not supported");
+  if(latency_timer < 0) printf("none\n");
+  else printf("%d ms\n", latency_timer);
+
+  if(!(t = (double *) malloc(sizeof(double) * n))) exit(1);
+  for (i = 0; i < n; i++) {
+    t0 = now();
+    meas_rs232_write(fd, "?\r", 2);
+    if(meas_rs232_readnl(fd, buf) < 0) break;
+    t[i] = 1E6 * (now() - t0);
+  }
+  n = i;
+  qsort(t, n, sizeof(double), cmp);
+  printf("%d requests: min %.1lf us, median %.1lf us, 99%% %.1lf us, max %.1lf us\n",
+	 n, t[0], t[n/2], t[(int) (0.99 * (n-1))], t[n-1]);
+
+  if(pid) kill(pid, SIGTERM);
+  meas_rs232_close(fd);
+  return 0;
+}
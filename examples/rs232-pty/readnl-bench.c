@@ -0,0 +1,109 @@
+/*
+ * Benchmark the RS232 line reader against a simulated instrument on a
+ * pseudo terminal (no hardware needed).
+ *
+ * The child process plays a pressure gauge: each 'p' it receives is answered
+ * by one reply line. The parent first reads the replies the old way (one
+ * read() per byte, wrapped in root on/off) and then with meas_rs232_readnl(),
+ * and prints the number of system calls and the time per line for both.
+ * Both counts are the read() and write() calls actually made plus the
+ * seteuid() calls counted by meas_misc_root_transitions() (cross-check
+ * with strace -c -f).
+ *
+ * Usage: readnl-bench [lines]
+ *
+ */
+
+#define _GNU_SOURCE   /* posix_openpt() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <meas/meas.h>
+
+#define REPLY " 1.2345E-05 Off\r"
+
+static void instrument(int master) {
+
+  char c;
+
+  while(read(master, &c, 1) == 1)
+    if(c == 'p') write(master, REPLY, sizeof(REPLY) - 1);
+  exit(0);
+}
+
+/* This is how meas_rs232_readnl() used to work. Returns the number of read() calls. */
+static long old_readnl(int fd, char *buf) {
+
+  int i = 0;
+  long nread = 0;
+
+  while(1) {
+    meas_misc_root_on();
+    read(fd, buf + i, 1);
+    meas_misc_root_off();
+    nread++;
+    if(buf[i] == MEAS_SERIAL_EOS) break;
+    i++;
+  }
+  buf[i] = 0;
+  return nread;
+}
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+
+  int master, fd, i, lines;
+  pid_t pid;
+  long nsys, nroot;
+  double t0, t_old, t_new;
+  char buf[512];
+
+  lines = (argc > 1)?atoi(argv[1]):10000;
+  if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    fprintf(stderr, "Can't open pty.\n");
+    exit(1);
+  }
+  fd = meas_rs232_open(ptsname(master), MEAS_B9600 | MEAS_NOHANDSHAKE);
+  if((pid = fork()) == 0) instrument(master);
+
+  nsys = 0;
+  nroot = meas_misc_root_transitions();
+  t0 = now();
+  for (i = 0; i < lines; i++) {
+    write(fd, "p", 1);
+    nsys += 1 + old_readnl(fd, buf);
+  }
+  t_old = now() - t0;
+  nroot = meas_misc_root_transitions() - nroot;
+  nsys += nroot;
+  printf("old:  %6.2lf syscalls/line, %8.2lf us/line\n", ((double) nsys) / lines, 1E6 * t_old / lines);
+  printf("      %ld privilege transitions\n", nroot);
+
+  nsys = meas_rs232_syscalls();
+  nroot = meas_misc_root_transitions();
+  t0 = now();
+  for (i = 0; i < lines; i++) {
+    meas_rs232_writeb(fd, 'p');
+    meas_rs232_readnl(fd, buf);
+  }
+  t_new = now() - t0;
+  nroot = meas_misc_root_transitions() - nroot;
+  nsys = meas_rs232_syscalls() - nsys + nroot;
+  printf("new:  %6.2lf syscalls/line, %8.2lf us/line (last line: \"%s\")\n", ((double) nsys) / lines, 1E6 * t_new / lines, buf);
+  printf("      %ld privilege transitions\n", nroot);
+
+  kill(pid, SIGTERM);
+  meas_rs232_close(fd);
+  return 0;
+}
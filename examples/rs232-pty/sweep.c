@@ -0,0 +1,92 @@
+/*
+ * Poll several slow instruments (simulated on pseudo terminals) first one
+ * after another with meas_rs232_readnl() and then concurrently with the
+ * RS232 transaction engine.
+ *
+ * Each child process answers 'p' after its own delay. The sequential sweep
+ * takes the sum of the delays, the engine sweep only the longest one.
+ *
+ * Usage: sweep [sweeps]
+ *
+ */
+
+#define _GNU_SOURCE   /* posix_openpt() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <meas/meas.h>
+
+#define NPORTS 4
+
+static int delay_ms[NPORTS] = {20, 50, 80, 120};
+
+static void instrument(int master, int id) {
+
+  char c, buf[64];
+
+  while(read(master, &c, 1) == 1)
+    if(c == 'p') {
+      usleep(1000 * delay_ms[id]);
+      sprintf(buf, "%d %d.000E-06\r", id, delay_ms[id]);
+      write(master, buf, strlen(buf));
+    }
+  exit(0);
+}
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+
+  int master, fd[NPORTS], i, j, h, status, sweeps, nok;
+  pid_t pid[NPORTS];
+  double t0;
+  char buf[512];
+
+  sweeps = (argc > 1)?atoi(argv[1]):5;
+  for (i = 0; i < NPORTS; i++) {
+    if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+      fprintf(stderr, "Can't open pty.\n");
+      exit(1);
+    }
+    fd[i] = meas_rs232_open(ptsname(master), MEAS_B9600 | MEAS_NOHANDSHAKE);
+    meas_rs232_set_timeout(fd[i], 1.0);
+    if((pid[i] = fork()) == 0) instrument(master, i);
+    close(master);
+  }
+
+  t0 = now();
+  for (j = 0; j < sweeps; j++)
+    for (i = 0; i < NPORTS; i++) {
+      meas_rs232_writeb(fd[i], 'p');
+      meas_rs232_readnl(fd[i], buf);
+    }
+  printf("sequential: %8.2lf ms/sweep\n", 1E3 * (now() - t0) / sweeps);
+
+  t0 = now();
+  nok = 0;
+  for (j = 0; j < sweeps; j++) {
+    for (i = 0; i < NPORTS; i++)
+      meas_rs232_engine_submit(fd[i], "p", 1, "\r", 1.0);
+    while((h = meas_rs232_engine_next(-1.0)) >= 0) {
+      meas_rs232_engine_result(h, buf, &status);
+      if(status == MEAS_RS232_OK) nok++;
+    }
+  }
+  printf("engine:     %8.2lf ms/sweep (%d/%d replies)\n", 1E3 * (now() - t0) / sweeps, nok, NPORTS * sweeps);
+
+  for (i = 0; i < NPORTS; i++) {
+    kill(pid[i], SIGTERM);
+    meas_rs232_close(fd[i]);
+  }
+  return 0;
+}
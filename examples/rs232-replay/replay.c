@@ -0,0 +1,132 @@
+/*
+ * Serve a recorded RS232 conversation (see meas_rs232_capture()) on a pseudo
+ * terminal, so that a driver can be run and profiled without the instrument.
+ *
+ * Whatever the program under test writes is consumed in place of the
+ * recorded transmissions (differences are reported) and the recorded
+ * replies are sent back with the original timing multiplied by scale
+ * (0 = reply immediately).
+ *
+ * Usage: replay [-s scale] [-l link] capture-file
+ *
+ * The pty device name is printed; with -l a symlink to it is created
+ * (e.g. -l /tmp/ttyDK240), which can then be given to the driver's open
+ * function.
+ *
+ * To record: MEAS_RS232_CAPTURE=/tmp/run ./program  (-> /tmp/run-ttyS0.cap)
+ *
+ */
+
+#define _GNU_SOURCE   /* posix_openpt() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <meas/meas.h>
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+/* Read one record. Returns data length or -1 at end of file. */
+static int get_record(FILE *fp, double *t, int *dir, unsigned char **data) {
+
+  unsigned char hdr[13];
+  unsigned long long ns = 0;
+  unsigned int len = 0;
+  int i;
+
+  if(fread(hdr, sizeof(hdr), 1, fp) != 1) return -1;
+  for (i = 0; i < 8; i++)
+    ns |= ((unsigned long long) hdr[i]) << (8 * i);
+  for (i = 0; i < 4; i++)
+    len |= ((unsigned int) hdr[9 + i]) << (8 * i);
+  *t = 1E-9 * (double) ns;
+  *dir = hdr[8];
+  if(!(*data = (unsigned char *) realloc(*data, len + 1))) return -1;
+  if(fread(*data, len, 1, fp) != 1) return -1;
+  return (int) len;
+}
+
+int main(int argc, char **argv) {
+
+  FILE *fp;
+  int master, opt, dir, len, i, rec = 0, diffs = 0;
+  double scale = 1.0, t, t_prev = -1.0, t_local, delay;
+  char *link = NULL, magic[8];
+  unsigned char *data = NULL, c;
+  struct pollfd pfd;
+
+  while((opt = getopt(argc, argv, "s:l:")) != -1)
+    switch(opt) {
+    case 's':
+      scale = atof(optarg);
+      break;
+    case 'l':
+      link = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: replay [-s scale] [-l link] capture-file\n");
+      exit(1);
+    }
+  if(optind != argc - 1) {
+    fprintf(stderr, "Usage: replay [-s scale] [-l link] capture-file\n");
+    exit(1);
+  }
+  if(!(fp = fopen(argv[optind], "r")) || fread(magic, 8, 1, fp) != 1 || memcmp(magic, MEAS_RS232_CAPTURE_MAGIC, 8)) {
+    fprintf(stderr, "replay: %s is not a capture file.\n", argv[optind]);
+    exit(1);
+  }
+  if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    fprintf(stderr, "replay: Can't open pty.\n");
+    exit(1);
+  }
+  printf("%s\n", ptsname(master));
+  fflush(stdout);
+  if(link) {
+    unlink(link);
+    if(symlink(ptsname(master), link) < 0) fprintf(stderr, "replay: Can't create %s.\n", link);
+  }
+
+  /* wait for the program to open the port (and flush its input) */
+  pfd.fd = master;
+  pfd.events = POLLIN;
+  do {
+    usleep(10000);
+    poll(&pfd, 1, 0);
+  } while(pfd.revents & POLLHUP);
+  usleep(50000);
+
+  t_local = now();
+  while((len = get_record(fp, &t, &dir, &data)) >= 0) {
+    rec++;
+    if(dir == MEAS_RS232_CAPTURE_TX) {
+      /* consume what the program sends */
+      for (i = 0; i < len; i++) {
+	if(read(master, &c, 1) != 1) {
+	  fprintf(stderr, "replay: Port closed at record %d.\n", rec);
+	  exit(0);
+	}
+	if(c != data[i]) diffs++;
+      }
+    } else {
+      if(t_prev >= 0.0 && (delay = scale * (t - t_prev) - (now() - t_local)) > 0.0)
+	meas_misc_nsleep((time_t) delay, (long) (1E9 * (delay - (double) (time_t) delay)));
+      write(master, data, len);
+    }
+    t_prev = t;
+    t_local = now();
+  }
+  fprintf(stderr, "replay: %d records served, %d bytes differed from the recording.\n", rec, diffs);
+  /* keep the pty open until the program closes it */
+  while(read(master, &c, 1) == 1);
+  if(link) unlink(link);
+  return 0;
+}
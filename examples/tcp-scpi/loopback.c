@@ -0,0 +1,104 @@
+/*
+ * HP34401A driver over the TCP transport against a local stand-in for an
+ * LXI instrument (no hardware needed).
+ *
+ * The child process listens on a loopback port and answers SCPI queries
+ * like a meter on port 5025 would (LF terminated lines). The parent opens
+ * the meter with meas_transport_tcp(), reads it repeatedly and prints the
+ * time per reading. A query that the server does not answer is then used
+ * to check that the read times out and the transport recovers.
+ *
+ * Usage: loopback [readings]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <meas/meas.h>
+
+#define READING "+1.23456789E+00\n"
+
+/* Answer one line. Unknown commands get no reply. */
+static void answer(int fd, char *line) {
+
+  if(!strcmp(line, "*IDN?")) write(fd, "HEWLETT-PACKARD,34401A,0,11-5-2\n", 32);
+  else if(!strcmp(line, "MEAS?") || !strcmp(line, "READ?") || !strcmp(line, "FETC?")) write(fd, READING, strlen(READING));
+}
+
+static void instrument(int lfd) {
+
+  char buf[4096], line[256];
+  int fd, i, n, len = 0;
+
+  if((fd = accept(lfd, NULL, NULL)) < 0) exit(1);
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    for (i = 0; i < n; i++) {
+      if(buf[i] == '\n') {
+	line[len] = 0;
+	answer(fd, line);
+	len = 0;
+      } else if(len < sizeof(line) - 1) line[len++] = buf[i];
+    }
+  exit(0);
+}
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+
+  struct sockaddr_in addr;
+  socklen_t alen = sizeof(addr);
+  int lfd, t, i, n;
+  pid_t pid;
+  double t0, val = 0.0;
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
+
+  n = (argc > 1)?atoi(argv[1]):10000;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;  /* any free port */
+  if((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+     listen(lfd, 1) < 0 || getsockname(lfd, (struct sockaddr *) &addr, &alen) < 0) {
+    fprintf(stderr, "Can't create server socket.\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0) instrument(lfd);
+  close(lfd);
+
+  if((t = meas_transport_tcp("127.0.0.1", ntohs(addr.sin_port))) < 0) exit(1);
+  meas_transport_timeout(t, 1.0);
+  meas_hp34401a_open_transport(0, t);
+  meas_transport_query(t, "*IDN?", buf, sizeof(buf));
+  printf("connected to port %d: %s\n", ntohs(addr.sin_port), buf);
+
+  t0 = now();
+  for (i = 0; i < n; i++)
+    val = meas_hp34401a_read_auto(0);
+  printf("tcp: %8.2lf us/reading (%.8lf)\n", 1E6 * (now() - t0) / n, val);
+
+  /* no reply: must time out */
+  meas_transport_timeout(t, 0.1);
+  t0 = now();
+  i = meas_transport_query(t, "SYST:ERR?", buf, sizeof(buf));
+  printf("unanswered query: returned %d after %.0lf ms\n", i, 1E3 * (now() - t0));
+  meas_transport_flush(t);
+  printf("after flush: %.8lf\n", meas_hp34401a_read_auto(0));
+
+  meas_transport_close(t);
+  kill(pid, SIGTERM);
+  return 0;
+}
@@ -14,10 +14,25 @@
 #include <unistd.h>
 #include "bnc565.h"
 #include "gpib.h"
+#include "shadow.h"
 #include "misc.h"
 
 /* Up to 5 devices supported */
 static int bnc565_fd[5] = {-1, -1, -1, -1, -1};
+static int bnc565_shadow[5] = {-1, -1, -1, -1, -1};
+
+/* Send a setting unless the unit already has it (the SCPI header identifies the setting) */
+static int set(int unit, char *cmd) {
+
+  int keylen = strcspn(cmd, " ");
+
+  if(!meas_shadow_update(bnc565_shadow[unit], cmd, keylen)) return 0;
+  if(meas_gpib_write(bnc565_fd[unit], cmd, MEAS_BNC565_TERM) < 0) {
+    meas_shadow_forget(bnc565_shadow[unit], cmd, keylen);
+    return -1;
+  }
+  return 0;
+}
 
 /* Initialize the DAC interface */
 EXPORT int meas_bnc565_open(int unit, int board, int dev) {
@@ -27,9 +42,11 @@ EXPORT int meas_bnc565_open(int unit, int board, int dev) {
   if(bnc565_fd[unit] == -1) {
     bnc565_fd[unit] = meas_gpib_open(board, dev);
     meas_gpib_timeout(bnc565_fd[unit], 1.0);
+    bnc565_shadow[unit] = meas_shadow_open();
   }
+  meas_shadow_invalidate(bnc565_shadow[unit]);
   meas_bnc565_run(unit, 0); /* stop */
-  meas_gpib_write(bnc565_fd[unit], ":PULSE0:MODE SINGLE", MEAS_BNC565_TERM);   /* force single shot mode */
+  set(unit, ":PULSE0:MODE SINGLE");   /* force single shot mode */
   return 0;
 }
 
@@ -65,20 +82,20 @@ EXPORT int meas_bnc565_set(int unit, int channel, int origin, double delay, doub
   
   /* Sync source */
   sprintf(buf, ":PULSE%d:SYNC %s", channel, src);
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
 
   /* Pulse delay */
   sprintf(buf, ":PULSE%d:DELAY %le", channel, delay);
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
 
   /* Pulse width */
   sprintf(buf, ":PULSE%d:WIDTH %le", channel, width);
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
   
   /* Polarity */
   sprintf(buf, ":PULSE%d:POLARITY %s", channel, 
 	  (polarity==MEAS_BNC565_POL_INV)?"INVERTED":"NORMAL");
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
 
   /* Level (remove if necessary - just for safety) */
   /* TODO: add a global variable that can be used to override this */
@@ -87,9 +104,9 @@ EXPORT int meas_bnc565_set(int unit, int channel, int origin, double delay, doub
     meas_err("meas_bnc565: Output level greater than 5 V requested! Won't do.");
 #endif
   sprintf(buf, ":PULSE%d:OUTPUT:MODE ADJUSTABLE", channel);
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
   sprintf(buf, ":PULSE%d:OUTPUT:AMPLITUDE %lf", channel, level);
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
   return 0;
 }
 
@@ -111,17 +128,17 @@ EXPORT int meas_bnc565_trigger(int unit, int source, double data, int edge) {
   
   if(bnc565_fd[unit] == -1) meas_err("mea_bnc565: non-existent unit.");
   if(source == MEAS_BNC565_TRIG_INT) { /* internal trigger */
-    meas_gpib_write(bnc565_fd[unit], ":PULSE0:EXT:MODE DISABLED", MEAS_BNC565_TERM); /* disable ext trigger */
+    set(unit, ":PULSE0:EXT:MODE DISABLED"); /* disable ext trigger */
     sprintf(buf, ":PULSE0:PERIOD %lf", 1.0 / data); /* %lf? */
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
-    meas_gpib_write(bnc565_fd[unit], ":PULSE0:MODE NORM", MEAS_BNC565_TERM);
+    set(unit, buf);
+    set(unit, ":PULSE0:MODE NORM");
   } else { /* external triggering */
-    meas_gpib_write(bnc565_fd[unit], ":PULSE0:EXT:MODE TRIGGER", MEAS_BNC565_TERM); /* external triggering */
+    set(unit, ":PULSE0:EXT:MODE TRIGGER"); /* external triggering */
     sprintf(buf, ":PULSE0:EXT:LEVEL %lf", data); /* trigger level (V) */
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     sprintf(buf, ":PULSE0:EXT:EDGE %s", (edge==MEAS_BNC565_TRIG_FALL)?"FALLING":"RISING");
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
-    meas_gpib_write(bnc565_fd[unit], ":PULSE0:EXT:POLARITY HIGH", MEAS_BNC565_TERM);
+    set(unit, buf);
+    set(unit, ":PULSE0:EXT:POLARITY HIGH");
   }
   return 0;
 }
@@ -140,6 +157,7 @@ EXPORT int meas_bnc565_run(int unit, int mode) {
 
   if(bnc565_fd[unit] == -1) meas_err("meas_bnc565: non-existent unit.");
   sprintf(buf, ":PULSE0:STATE %s", mode?"ON":"OFF");
+  /* not cached: in single shot mode the unit stops by itself after the pulse */
   meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
   return 0;
 }
@@ -162,7 +180,7 @@ EXPORT int meas_bnc565_enable(int unit, int channel, int status) {
   if(channel < MEAS_BNC565_CHA || channel > MEAS_BNC565_CHD)
     meas_err("meas_bnc565: unknown channel.");
   sprintf(buf, ":PULSE%d:STATE %s", channel, status?"ON":"OFF");
-  meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+  set(unit, buf);
   return 0;
 }
 
@@ -201,35 +219,35 @@ EXPORT int meas_bnc565_mode(int unit, int channel, int mode, int data1, int data
   switch(mode) {
   case MEAS_BNC565_MODE_CONTINUOUS:
     sprintf(buf, ":PULSE%d:CMODE NORM", channel);
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     break;
   case MEAS_BNC565_MODE_DUTY_CYCLE:
     /* TODO: there are probably some surprises here - just like in the burst mode - NOT TESTED! */
     sprintf(buf, ":PULSE%d:CMODE DCYC", channel);
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     sprintf(buf, ":PULSE%d:PCO %d", channel, data1);
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     sprintf(buf, ":PULSE%d:OCO %d", channel, data2);
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     break;
   case MEAS_BNC565_MODE_BURST: /* force ext trigger & set period */
-    meas_gpib_write(bnc565_fd[unit], ":PULSE0:EXT:MODE TRIGGER", MEAS_BNC565_TERM); /* external triggering - just for safety as we set the period. Use meas_bnc565_trigger() to set the triggering parameters */
+    set(unit, ":PULSE0:EXT:MODE TRIGGER"); /* external triggering - just for safety as we set the period. Use meas_bnc565_trigger() to set the triggering parameters */
     sprintf(buf, ":PULSE0:PERIOD %lf", data3); /* %lf? */
     /*    data1 *= 2; data2 *= 2; */
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     sprintf(buf, ":PULSE0:MODE BURS");
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);    
+    set(unit, buf);    
     sprintf(buf, ":PULSE0:BCO %d", data2);           /* maximum number of pulses possible in burst */
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     sprintf(buf, ":PULSE%d:CMODE BURS", channel);
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     sprintf(buf, ":PULSE%d:BCO %d", channel, data1);           /* number of pulses in a burst for a given channel */
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     /* Note: To get a channel which outputs only one pulse, set it to burst and the # of pulses to 1 */
     break;
   case MEAS_BNC565_MODE_SINGLE_SHOT:
     sprintf(buf, ":PULSE%d:CMODE SING", channel);
-    meas_gpib_write(bnc565_fd[unit], buf, MEAS_BNC565_TERM);
+    set(unit, buf);
     break;
   default:
     meas_err("meas_bnc565: illegal channel mode.");
@@ -237,4 +255,18 @@ EXPORT int meas_bnc565_mode(int unit, int channel, int mode, int data1, int data
   return 0;
 }
 
+/*
+ * Forget the settings sent to the unit, so that they are all sent again
+ * (call after changing settings on the front panel).
+ *
+ * unit = Unit to be addressed.
+ *
+ */
+
+EXPORT int meas_bnc565_invalidate(int unit) {
+
+  if(bnc565_fd[unit] == -1) meas_err("meas_bnc565: non-existent unit.");
+  return meas_shadow_invalidate(bnc565_shadow[unit]);
+}
+
 #endif /* GPIB */
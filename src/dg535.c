@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include "dg535.h"
 #include "gpib.h"
+#include "shadow.h"
 #include "misc.h"
 
 /* Up to 5 devices supported */
@@ -21,6 +22,25 @@ static int dg535_fd[5] = {-1, -1, -1, -1, -1};
 static double vals[5][8];
 static int trigger_source[5] = {MEAS_DG535_TRIG_EXT, MEAS_DG535_TRIG_EXT, MEAS_DG535_TRIG_EXT, MEAS_DG535_TRIG_EXT, MEAS_DG535_TRIG_EXT};
 static double reprate[5] = {1.0, 1.0, 1.0, 1.0, 1.0};
+static int dg535_shadow[5] = {-1, -1, -1, -1, -1};
+
+/*
+ * Send a setting unless the unit already has it. The setting is identified
+ * by the command and its first argument (e.g. "DT 2" for "DT 2,1,1E-6").
+ *
+ */
+
+static int set(int unit, char *cmd) {
+
+  int keylen = strchr(cmd, ',')?strcspn(cmd, ","):strcspn(cmd, " ");
+
+  if(!meas_shadow_update(dg535_shadow[unit], cmd, keylen)) return 0;
+  if(meas_gpib_write(dg535_fd[unit], cmd, MEAS_DG535_TERM) < 0) {
+    meas_shadow_forget(dg535_shadow[unit], cmd, keylen);
+    return -1;
+  }
+  return 0;
+}
 
 /* Initialize the DAC interface */
 EXPORT int meas_dg535_open(int unit, int board, int dev) {
@@ -33,6 +53,7 @@ EXPORT int meas_dg535_open(int unit, int board, int dev) {
   if(dg535_fd[unit] == -1) {
     dg535_fd[unit] = meas_gpib_open(board, dev);
     meas_gpib_timeout(dg535_fd[unit], 1.0);
+    dg535_shadow[unit] = meas_shadow_open();
     sprintf(buf, "CL"); /* Clear device */
     meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
     for (i = 0; i < 8; i++) vals[unit][i] = 0.1;
@@ -65,24 +86,24 @@ EXPORT int meas_dg535_set(int unit, int channel, int origin, double delay, doubl
   /* Set channel delay */
   if(channel != MEAS_DG535_T0 && channel != MEAS_DG535_CHAB && channel != MEAS_DG535_CHCD) {
     sprintf(buf, "DT %d,%d,%le", channel, origin, delay);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
   }
 
   /* Output level */
   sprintf(buf, "TZ %d,%d", channel, imp);   /* impedance */
-  meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+  set(unit, buf);
   sprintf(buf, "OM %d,3", channel);    /* variable mode */
-  meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+  set(unit, buf);
   sprintf(buf, "OO %d,%.1lf", channel, offset);    /* offset = 0 V */
-  meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+  set(unit, buf);
   sprintf(buf, "OA %d,%.1lf", channel, level);   /* output level (V) (maximum 4 volts) */
-  meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+  set(unit, buf);
   vals[unit][channel] = level;
 
   /* Polarity */
   if(channel != MEAS_DG535_T0 && channel != MEAS_DG535_CHAB && channel != MEAS_DG535_CHCD) {
     sprintf(buf, "OP %d,%d", channel, polarity);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);  
+    set(unit, buf);
   }
  
   return 0;
@@ -95,18 +116,18 @@ EXPORT int meas_dg535_enable(int unit, int channel, int status) {
 
   if(status == 1) { /* Enable */
     sprintf(buf, "OA %d,%le", channel, vals[unit][channel]);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sprintf(buf, "OM %d,3", channel);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
   } else { /* Disable */
     sprintf(buf, "OA %d", channel);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);  /* query */
     meas_gpib_read(dg535_fd[unit], buf);
     vals[unit][channel] = atof(buf);
     sprintf(buf, "OA %d,0.1", channel);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sprintf(buf, "OM %d,3", channel);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
   } 
   return 0;
 }
@@ -129,21 +150,21 @@ EXPORT int meas_dg535_trigger(int unit, int source, double data, int edge, int i
   if(source == MEAS_DG535_TRIG_EXT) { /* external trigger */
     trigger_source[unit] = MEAS_DG535_TRIG_EXT;
     sprintf(buf, "TM 1");
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sprintf(buf, "TL %lf", data);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sprintf(buf,"TZ 0,%d", imp);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sprintf(buf,"TS %d", edge);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
   } else { /* Internal trigger */
     trigger_source[unit] = MEAS_DG535_TRIG_INT;
     meas_dg535_run(unit, 0); /* stop for safety first */
     sprintf(buf, "TR 0,%lf", data);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     reprate[unit] = data;
     sprintf(buf, "TM 0");
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sleep(2);
     meas_dg535_run(unit, 1); /* stop for safety first */
   }
@@ -187,19 +208,19 @@ EXPORT int meas_dg535_mode(int unit, int mode, int bc, int bp) {
   if(mode == MEAS_DG535_MODE_SS) {
     /* Restore previous regular triggering mode (either int or ext) */
     sprintf(buf, "TM %1d", trigger_source[unit]);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);      
+    set(unit, buf);
   } else if (mode == MEAS_DG535_MODE_BURST) {
     sprintf(buf, "TM 3");
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);      
+    set(unit, buf);
     sprintf(buf, "TR 1,%lf", reprate[unit]);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
     sprintf(buf, "BC %d", bc);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);      
+    set(unit, buf);
     sprintf(buf, "BP %d", bp);
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);      
+    set(unit, buf);
   } else { /* software trigger (MODE_SOFT) */
     sprintf(buf, "TM 2");
-    meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);
+    set(unit, buf);
   }
   return 0;
 }
@@ -210,8 +231,20 @@ EXPORT int meas_dg535_do_trigger(int unit) {
   char buf[512];
 
   sprintf(buf, "SS");
-  meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);  
+  meas_gpib_write(dg535_fd[unit], buf, MEAS_DG535_TERM);  /* action: never cached */  
   return 0;
 }
 
+/*
+ * Forget the settings sent to the unit, so that they are all sent again
+ * (call after changing settings on the front panel).
+ *
+ */
+
+EXPORT int meas_dg535_invalidate(int unit) {
+
+  if(dg535_fd[unit] == -1) meas_err("meas_dg535_invalidate: Non-existent unit.");
+  return meas_shadow_invalidate(dg535_shadow[unit]);
+}
+
 #endif /* GPIB */
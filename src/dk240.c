@@ -9,12 +9,42 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dk240.h"
 #include "serial.h"
 #include "misc.h"
 
 static int dk240_fd[5] = {-1, -1, -1, -1, -1};
 
+/*
+ * Send command (with parameters) and read the reply frame: echo, npayload
+ * bytes, status byte (ignored for now) and EOT.
+ *
+ */
+
+static int dk240_cmd(int unit, unsigned char cmd, unsigned char *params, int nparams, unsigned char *payload, int npayload) {
+
+  struct meas_rs232_frame spec;
+
+  spec.echo = cmd;
+  spec.npayload = npayload;
+  spec.status = 1;
+  spec.eot = MEAS_DK240_EOT;
+  return meas_rs232_frame_cmd(dk240_fd[unit], cmd, params, nparams, &spec, payload, NULL);
+}
+
+/* Encode wavelength (nm) for GOTO and GCAL */
+static void dk240_wl(unsigned char *buf, double wl) {
+
+  unsigned int wll;
+
+  wll = wl * 100;
+  buf[0] = wll / 65536;
+  wll = wll % 65536;
+  buf[1] = wll / 256;
+  buf[2] = wll % 256;
+}
+
 /*
  * Initialize monochromator & perform handshake with the instrument.
  *
@@ -25,16 +55,15 @@ static int dk240_fd[5] = {-1, -1, -1, -1, -1};
 
 EXPORT int meas_dk240_open(int unit, char *dev) {
 
-  char resp;
+  struct meas_rs232_frame spec = {MEAS_DK240_ECHO, 0, 0, -1};
 
   if(dk240_fd[unit] == -1) {
-    dk240_fd[unit] = meas_rs232_open(dev, 0);
+    dk240_fd[unit] = meas_rs232_open(dev, MEAS_B9600);
     /* could do also a reset here ? - might be slow... */
   }
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_ECHO);
-  meas_rs232_read(dk240_fd[unit], &resp, 1);
-  if(resp != MEAS_DK240_ECHO) meas_err("meas_dk240: monochromator handshake failed.");
+  if(meas_rs232_frame_cmd(dk240_fd[unit], MEAS_DK240_ECHO, NULL, 0, &spec, NULL, NULL) < 0)
+    meas_err("meas_dk240: monochromator handshake failed.");
   meas_misc_enable_signals();
 
   return 0;
@@ -50,29 +79,15 @@ EXPORT int meas_dk240_open(int unit, char *dev) {
 
 EXPORT int meas_dk240_setwl(int unit, double wl) {
 
-  unsigned char buf[3], tmp;
-  unsigned int wll;
+  unsigned char buf[3];
 
   if(dk240_fd[unit] == -1)
     meas_err("dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_GOTO);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_GOTO) 
+  dk240_wl(buf, wl);
+  if(dk240_cmd(unit, MEAS_DK240_GOTO, buf, 3, NULL, 0) < 0)
     meas_err("meas_dk240: Unexpected response (GOTO).");
-
-  wll = wl * 100;
-  buf[0] = wll / 65536;
-  wll = wll % 65535;
-  buf[1] = wll / 256;
-  buf[2] = wll % 256;
-  meas_rs232_write(dk240_fd[unit], buf, 3);
-  meas_rs232_read(dk240_fd[unit], &tmp, 1);
-  /* status reply ignored for now */
-  meas_rs232_read(dk240_fd[unit], &tmp, 1);
-  if(tmp != MEAS_DK240_EOT)
-    meas_err("dk240: Unexpected response (EOT).");
   meas_misc_enable_signals();
 
   /* TODO: how do we ensure that the monochromator has moved before we return? */
@@ -97,19 +112,9 @@ EXPORT double meas_dk240_getwl(int unit) {
     meas_err("meas_dk240: non-existent monochromator.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_WAVEQ);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_WAVEQ)
+  if(dk240_cmd(unit, MEAS_DK240_WAVEQ, NULL, 0, buf, 3) < 0)
     meas_err("meas_dk240: error getting wavelength.");
-
-  meas_rs232_read(dk240_fd[unit], buf, 3);  
   wl = ((double) (65536 * buf[0] + 256 * buf[1] + buf[2])) / 100.0;
-  
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  /* ignore status for now */
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_EOT)
-    meas_err("meas_dk240: error getting wavelength.");
   meas_misc_enable_signals();
 
   return wl;
@@ -132,28 +137,13 @@ EXPORT int meas_dk240_set_slits(int unit, double input, double output) {
     meas_err("meas_dk240: non-existing monochromator.");
   
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_S1ADJ);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_S1ADJ)
-    meas_err("meas_dk240: error setting slits.");
   buf[0] = ((int) input) / 256;
   buf[1] = ((int) input) % 256;
-  meas_rs232_write(dk240_fd[unit], buf, 2);
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* status byte - ignored for now */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
-    meas_err("meas_dk240: error setting slits.");
-
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_S2ADJ);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_S2ADJ)
+  if(dk240_cmd(unit, MEAS_DK240_S1ADJ, buf, 2, NULL, 0) < 0)
     meas_err("meas_dk240: error setting slits.");
   buf[0] = ((int) output) / 256;
   buf[1] = ((int) output) % 256;
-  meas_rs232_write(dk240_fd[unit], buf, 2);
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* status byte - ignored for now */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  if(dk240_cmd(unit, MEAS_DK240_S2ADJ, buf, 2, NULL, 0) < 0)
     meas_err("meas_dk240: error setting slits.");
   meas_misc_enable_signals();
 
@@ -177,20 +167,10 @@ EXPORT int meas_dk240_get_slits(int unit, double *input, double *output) {
     meas_err("meas_dk240: non-existent monochromator.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_SLITQ);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_SLITQ)
+  if(dk240_cmd(unit, MEAS_DK240_SLITQ, NULL, 0, buf, 4) < 0)
     meas_err("meas_dk240: error getting slits.");
-
-  meas_rs232_read(dk240_fd[unit], buf, 4);
   *input = buf[0] * 256 + buf[1];
   *output = buf[2] * 256 + buf[3];
-
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_EOT) 
-    meas_err("meas_dk240: error getting slits.");;
   meas_misc_enable_signals();
 
   return 0;
@@ -238,28 +218,18 @@ EXPORT double meas_dk240_calib(double real_wl) {
  
 EXPORT int meas_dk240_grating_info(int unit, int *ngratings, int *cur_grating, int *ruling, int *blaze) {
 
-  unsigned char buf[5];
+  unsigned char buf[8];
 
   if(dk240_fd[unit] == -1) meas_err("meas_dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_GRTID);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_GRTID) 
-    meas_err("meas_dk240: Unexpected response (GRTID).");
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  *ngratings = (int) buf[0];
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  *cur_grating = (int) buf[0];
-  meas_rs232_read(dk240_fd[unit], buf, 2);
-  *ruling = (int) (256 * buf[0] + buf[1]);
-  meas_rs232_read(dk240_fd[unit], buf, 2);
-  *blaze = (int) (256 * buf[0] + buf[1]);
-  meas_rs232_read(dk240_fd[unit], buf, 2);
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  /* ngratings, current grating, ruling (2), blaze (2), 2 unused bytes */
+  if(dk240_cmd(unit, MEAS_DK240_GRTID, NULL, 0, buf, 8) < 0)
     meas_err("meas_dk240: error reading grating info.");
+  *ngratings = (int) buf[0];
+  *cur_grating = (int) buf[1];
+  *ruling = (int) (256 * buf[2] + buf[3]);
+  *blaze = (int) (256 * buf[4] + buf[5]);
   meas_misc_enable_signals();
 
   return 0;
@@ -275,7 +245,7 @@ EXPORT int meas_dk240_grating_info(int unit, int *ngratings, int *cur_grating, i
 
 EXPORT int meas_dk240_grating_select(int unit, int grating) {
 
-  unsigned char buf[5];
+  unsigned char buf[1];
 
   if(dk240_fd[unit] == -1) 
     meas_err("meas_dk240: non-existent unit.");
@@ -283,14 +253,8 @@ EXPORT int meas_dk240_grating_select(int unit, int grating) {
     meas_err("meas_dk240: invalid grating number.");
   
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_GRTSEL);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_GRTSEL)
-    meas_err("meas_dk240: Unexpected response (GRTSEL).");
-  meas_rs232_writeb(dk240_fd[unit], (unsigned char) grating);
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  buf[0] = (unsigned char) grating;
+  if(dk240_cmd(unit, MEAS_DK240_GRTSEL, buf, 1, NULL, 0) < 0)
     meas_err("meas_dk240: error selecting grating.");
   meas_misc_enable_signals();
 
@@ -328,21 +292,19 @@ EXPORT int meas_dk240_reset(int unit) {
 
 EXPORT int meas_dk240_serial(int unit) {
 
-  unsigned char buf[5];
+  struct meas_rs232_frame spec = {MEAS_DK240_SERIAL, 5, 0, -1};
+  unsigned char buf[6];
 
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
   
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_SERIAL);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_SERIAL)
+  if(meas_rs232_frame_cmd(dk240_fd[unit], MEAS_DK240_SERIAL, NULL, 0, &spec, buf, NULL) < 0)
     meas_err("meas_dk240: Unexpected response (SERIAL).");
-  meas_rs232_read(dk240_fd[unit], buf, 5);
   meas_misc_enable_signals();
 
   buf[5] = 0;
-  return atoi(buf);
+  return atoi((char *) buf);
 }
 
 /*
@@ -357,19 +319,11 @@ EXPORT int meas_dk240_serial(int unit) {
 
 EXPORT int meas_dk240_nvram_clear(int unit) {
 
-  unsigned char buf[5];
-
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_CLEAR);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_CLEAR)
-    meas_err("meas_dk240: Unexpected response (CLEAR).");
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  if(dk240_cmd(unit, MEAS_DK240_CLEAR, NULL, 0, NULL, 0) < 0)
     meas_err("meas_dk240: error issuing clear.");
   meas_misc_enable_signals();
 
@@ -386,25 +340,17 @@ EXPORT int meas_dk240_nvram_clear(int unit) {
 
 EXPORT int meas_dk240_grating_zero(int unit) {
 
-  unsigned char buf[5];
+  unsigned char buf[1];
 
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_ZERO);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_ZERO)
-    meas_err("meas_dk240: Unexpected response (ZERO).");
-  meas_rs232_writeb(dk240_fd[unit], 1); /* TODO: for DK242 1 or 2 */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  buf[0] = 1; /* TODO: for DK242 1 or 2 */
+  if(dk240_cmd(unit, MEAS_DK240_ZERO, buf, 1, NULL, 0) < 0)
     meas_err("meas_dk240: error issuing zero.");
   meas_misc_enable_signals();
   return 0;
-
-
 }
 
 /*
@@ -422,26 +368,14 @@ EXPORT int meas_dk240_grating_zero(int unit) {
 
 EXPORT int meas_dk240_grating_calibrate(int unit, double wl) {
 
-  unsigned char buf[5];
-  unsigned int wll;
+  unsigned char buf[3];
 
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_GCAL);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_GCAL)
-    meas_err("meas_dk240: Unexpected response (GCAL).");
-  wll = wl * 100;
-  buf[0] = wll / 65536;
-  wll = wll % 65535;
-  buf[1] = wll / 256;
-  buf[2] = wll % 256;
-  meas_rs232_write(dk240_fd[unit], buf, 3);
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  dk240_wl(buf, wl);
+  if(dk240_cmd(unit, MEAS_DK240_GCAL, buf, 3, NULL, 0) < 0)
     meas_err("meas_dk240: error issuing grating calibrate.");
   meas_misc_enable_signals();
 
@@ -463,7 +397,8 @@ static int slew_active[5] = {0, 0, 0, 0, 0};
 
 EXPORT int meas_dk240_slew_start(int unit, int direction) {
 
-  unsigned char buf[5];
+  struct meas_rs232_frame spec = {0, 0, 0, -1};
+  unsigned char cmd;
 
   if(dk240_fd[unit] == -1) 
     meas_err("meas_dk240: non-existent unit.");
@@ -472,12 +407,9 @@ EXPORT int meas_dk240_slew_start(int unit, int direction) {
   if(slew_active[unit])
     meas_err("meas_dk240: Can't initiate slew when already active.");
 
-  meas_rs232_writeb(dk240_fd[unit], direction?MEAS_DK240_SLEWUP:MEAS_DK240_SLEWDOWN);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(direction == 1 && buf[0] != MEAS_DK240_SLEWUP)
-    meas_err("meas_dk240: Unexpected response (SLEWUP).");
-  if(direction == 0 && buf[0] != MEAS_DK240_SLEWDOWN)
-    meas_err("meas_dk240: Unexpected response (SLEWDOWN).");
+  spec.echo = cmd = direction?MEAS_DK240_SLEWUP:MEAS_DK240_SLEWDOWN;
+  if(meas_rs232_frame_cmd(dk240_fd[unit], cmd, NULL, 0, &spec, NULL, NULL) < 0)
+    meas_err("meas_dk240: Unexpected response (SLEWUP/SLEWDOWN).");
   slew_active[unit] = 1;
   meas_misc_enable_signals();
 
@@ -493,7 +425,7 @@ EXPORT int meas_dk240_slew_start(int unit, int direction) {
 
 EXPORT int meas_dk240_slew_stop(int unit) {
   
-  unsigned char buf[5];
+  struct meas_rs232_frame spec = {-1, 0, 1, MEAS_DK240_EOT};
 
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
@@ -501,10 +433,7 @@ EXPORT int meas_dk240_slew_stop(int unit) {
   meas_misc_disable_signals();
   if(!slew_active[unit])
     meas_err("meas_dk240: Can't stop slew when not active.");
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_EOT);
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
+  if(meas_rs232_frame_cmd(dk240_fd[unit], MEAS_DK240_EOT, NULL, 0, &spec, NULL, NULL) < 0)
     meas_err("meas_dk240: error issuing slew stop.");
   slew_active[unit] = 0;
   meas_misc_enable_signals();
@@ -521,20 +450,12 @@ EXPORT int meas_dk240_slew_stop(int unit) {
 
 EXPORT int meas_dk240_step_down(int unit) {
 
-  unsigned char buf[5];
-  
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_STEPDOWN);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_STEPDOWN)
-    meas_err("meas_dk240: Unexpected response (STEPDOWN).");
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT)
-    meas_err("meas_dk240: error issuing slew stop.");
+  if(dk240_cmd(unit, MEAS_DK240_STEPDOWN, NULL, 0, NULL, 0) < 0)
+    meas_err("meas_dk240: error issuing step down.");
   meas_misc_enable_signals();
 
   return 0;
@@ -549,20 +470,12 @@ EXPORT int meas_dk240_step_down(int unit) {
 
 EXPORT int meas_dk240_step_up(int unit) {
 
-  unsigned char buf[5];
-  
   if(dk240_fd[unit] == -1)
     meas_err("meas_dk240: non-existent unit.");
 
   meas_misc_disable_signals();
-  meas_rs232_writeb(dk240_fd[unit], MEAS_DK240_STEPUP);
-  meas_rs232_read(dk240_fd[unit], buf, 1);
-  if(buf[0] != MEAS_DK240_STEPUP) 
-    meas_err("meas_dk240: Unexpected response (STEPUP).");
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* ignore status byte */
-  meas_rs232_read(dk240_fd[unit], buf, 1); /* EOT */
-  if(buf[0] != MEAS_DK240_EOT) 
-    meas_err("meas_dk240: error issuing slew stop.");
+  if(dk240_cmd(unit, MEAS_DK240_STEPUP, NULL, 0, NULL, 0) < 0)
+    meas_err("meas_dk240: error issuing step up.");
   meas_misc_enable_signals();
 
   return 0;
@@ -0,0 +1,350 @@
+/*
+ * Asynchronous GPIB transaction engine.
+ *
+ * Query transactions (command + reply) are submitted to any number of
+ * devices on one or more boards and run with ibwrta()/ibrda(), completion
+ * being detected with ibwait(CMPL).
+ *
+ * Only one transfer can be on a bus at a time, so on each board the
+ * queries are written to all devices first and the replies read after
+ * that. The instruments then settle and convert concurrently: a sweep over
+ * several slow instruments takes roughly as long as the slowest one rather
+ * than the sum of all of them. Different boards run fully in parallel.
+ *
+ * Transactions to the same device are run in the order they were
+ * submitted (the next query is sent only after the previous reply has been
+ * read).
+ *
+ * The engine itself is not thread safe: submit and collect transactions
+ * from one thread only. The rest of the GPIB layer may be used at the same
+ * time (from any thread): a call that needs the bus waits for the engine's
+ * transfer on that board to finish (see meas_gpib_async_start()).
+ *
+ * Typical use:
+ *
+ *   h1 = meas_gpib_engine_submit(dmm_fd, "READ?", 1, 2.0);
+ *   h2 = meas_gpib_engine_submit(counter_fd, ":READ?", 0, 2.0);
+ *   while((h = meas_gpib_engine_next(-1.0)) >= 0) {
+ *     meas_gpib_engine_result(h, buf, &status);
+ *     ...
+ *   }
+ *
+ */
+
+#ifdef GPIB
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gpib/ib.h>
+#include "gpib.h"
+#include "gpib-engine.h"
+#include "misc.h"
+
+/* Transaction states */
+#define XACT_FREE    0
+#define XACT_QUEUED  1  /* waiting to send the command */
+#define XACT_WRITING 2  /* command being sent */
+#define XACT_WRITTEN 3  /* command sent, waiting to read the reply */
+#define XACT_READING 4  /* reply being read */
+#define XACT_DONE    5  /* completed or timed out, not yet collected */
+
+struct xact {
+  int state;
+  int fd;                                    /* GPIB device */
+  int board;                                 /* board the device is on */
+  char cmd[MEAS_GPIB_ENGINE_CMDLEN];         /* command + terminator */
+  int cmdlen;
+  double timeout;                            /* timeout (s; from submission) */
+  struct timespec dl;                        /* deadline */
+  char reply[MEAS_GPIB_ENGINE_REPLYLEN];     /* reply */
+  int len;
+  int status;                                /* MEAS_GPIB_OK, ... */
+  int reported;                              /* returned by meas_gpib_engine_next() */
+  unsigned long seq;                         /* submission order */
+};
+
+static struct xact xacts[MEAS_GPIB_ENGINE_MAX];
+static struct xact *busy[MEAS_GPIB_MAXBOARDS];  /* async transfer in flight on each board */
+static unsigned long seq = 0;
+
+/* Set deadline timeout seconds from now */
+static void deadline_set(struct timespec *dl, double timeout) {
+
+  clock_gettime(CLOCK_MONOTONIC, dl);
+  dl->tv_sec += (time_t) timeout;
+  dl->tv_nsec += (long) (1E9 * (timeout - (double) (time_t) timeout));
+  if(dl->tv_nsec >= 1000000000L) {
+    dl->tv_sec++;
+    dl->tv_nsec -= 1000000000L;
+  }
+}
+
+/* Has deadline passed? */
+static int expired(struct timespec *dl) {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec > dl->tv_sec || (now.tv_sec == dl->tv_sec && now.tv_nsec >= dl->tv_nsec));
+}
+
+static void finish(struct xact *x, int status) {
+
+  x->state = XACT_DONE;
+  x->status = status;
+  x->reported = 0;
+  x->reply[x->len] = 0;
+}
+
+/*
+ * Time out a transaction. If the command has (partly) been sent, the
+ * device is cleared so that its late reply is not read by the next query
+ * to it. The board must not have a transfer in progress.
+ *
+ */
+
+static void expire(struct xact *x) {
+
+  int sent = (x->state >= XACT_WRITING);
+
+  x->len = 0;
+  finish(x, MEAS_GPIB_TIMEDOUT);
+  if(sent) meas_gpib_device_clear(x->fd);
+}
+
+/* Does the device have a query outstanding (sent but reply not read)? */
+static int dev_busy(int fd) {
+
+  int i;
+
+  for(i = 0; i < MEAS_GPIB_ENGINE_MAX; i++)
+    if(xacts[i].fd == fd && xacts[i].state >= XACT_WRITING && xacts[i].state <= XACT_READING) return 1;
+  return 0;
+}
+
+/*
+ * Start the next transfer on an idle board: writes first (oldest first),
+ * then reads. If the board is in use by another thread, try again later.
+ *
+ */
+
+static void schedule(int board) {
+
+  int i, rv;
+  struct xact *x;
+
+  while(!busy[board]) {
+    x = NULL;
+    for(i = 0; i < MEAS_GPIB_ENGINE_MAX; i++)
+      if(xacts[i].board == board && xacts[i].state == XACT_QUEUED && !dev_busy(xacts[i].fd)
+	 && (!x || xacts[i].seq < x->seq)) x = &xacts[i];
+    if(x) {
+      if(!(rv = meas_gpib_async_start(x->fd, x->cmd, x->cmdlen, 1))) return;
+      if(rv < 0) {
+	finish(x, MEAS_GPIB_ERROR);
+	continue;
+      }
+      x->state = XACT_WRITING;
+      busy[board] = x;
+      return;
+    }
+    for(i = 0; i < MEAS_GPIB_ENGINE_MAX; i++)
+      if(xacts[i].board == board && xacts[i].state == XACT_WRITTEN && (!x || xacts[i].seq < x->seq)) x = &xacts[i];
+    if(!x || !(rv = meas_gpib_async_start(x->fd, x->reply, MEAS_GPIB_ENGINE_REPLYLEN - 1, 0))) return;
+    if(rv < 0) {
+      x->len = 0;
+      finish(x, MEAS_GPIB_ERROR);
+      continue;
+    }
+    x->state = XACT_READING;
+    busy[board] = x;
+  }
+}
+
+/* Transfer on the board has completed (status sta, cnt bytes) */
+static void completed(int board, int sta, int cnt) {
+
+  struct xact *x = busy[board];
+
+  busy[board] = NULL;
+  if(sta & TIMO) expire(x);
+  else if(sta & ERR) {
+    x->len = 0;
+    finish(x, MEAS_GPIB_ERROR);
+  } else if(x->state == XACT_WRITING) x->state = XACT_WRITTEN;
+  else {
+    x->len = cnt;
+    finish(x, MEAS_GPIB_OK);
+  }
+  schedule(board);
+}
+
+/*
+ * Check transfers in progress. If block is set and only one transfer is in
+ * progress, wait for it in ibwait(); otherwise just poll. Returns 1 if
+ * ibwait() blocked, 0 if the caller should sleep before polling again.
+ *
+ */
+
+static int step(int block) {
+
+  int b, n = 0, sta, cnt;
+  struct xact *x;
+
+  for(b = 0; b < MEAS_GPIB_MAXBOARDS; b++)
+    if(busy[b]) n++;
+  block = (block && n == 1);
+  for(b = 0; b < MEAS_GPIB_MAXBOARDS; b++) {
+    if(!(x = busy[b])) {
+      schedule(b);  /* the board may have been locked by another thread */
+      continue;
+    }
+    if(meas_gpib_async_poll(b, block, &sta, &cnt) > 0) completed(b, sta, cnt);
+    else if(expired(&x->dl)) {
+      meas_gpib_async_stop(b);
+      busy[b] = NULL;
+      expire(x);
+      schedule(b);
+    }
+  }
+  /* queued transactions expire too (a sent one only when its board is free for the device clear) */
+  for(b = 0; b < MEAS_GPIB_ENGINE_MAX; b++) {
+    x = &xacts[b];
+    if((x->state == XACT_QUEUED || (x->state == XACT_WRITTEN && !busy[x->board])) && expired(&x->dl)) {
+      expire(x);
+      schedule(x->board);
+    }
+  }
+  return block;
+}
+
+/*
+ * Submit a query transaction. The command is sent as soon as the board
+ * is free, and the reply is read after the queries to the other devices on
+ * the same board have been sent.
+ *
+ * fd      = GPIB device (opened with meas_gpib_open()).
+ * cmd     = Command to send.
+ * crlf    = 0: use EOS, 1: use CR LF as line end.
+ * timeout = Timeout in seconds (counted from submission). The device
+ *           timeout (meas_gpib_timeout()) applies to each transfer as well.
+ *
+ * Returns transaction handle or -1 on error.
+ *
+ */
+
+EXPORT int meas_gpib_engine_submit(int fd, char *cmd, int crlf, double timeout) {
+
+  int i, len, board;
+  struct xact *x;
+
+  if((board = meas_gpib_board(fd)) < 0)
+    meas_err("meas_gpib_engine_submit: Device not open.");
+  if((len = strlen(cmd)) + 2 > MEAS_GPIB_ENGINE_CMDLEN)
+    meas_err("meas_gpib_engine_submit: Command too long.");
+  for(i = 0; i < MEAS_GPIB_ENGINE_MAX; i++)
+    if(xacts[i].state == XACT_FREE) break;
+  if(i == MEAS_GPIB_ENGINE_MAX)
+    meas_err("meas_gpib_engine_submit: Too many transactions pending.");
+  x = &xacts[i];
+  x->fd = fd;
+  x->board = board;
+  memcpy(x->cmd, cmd, len);
+  x->cmdlen = len + meas_gpib_terminator(fd, x->cmd + len, crlf);
+  x->timeout = timeout;
+  deadline_set(&x->dl, timeout);
+  x->len = 0;
+  x->seq = seq++;
+  x->state = XACT_QUEUED;
+  schedule(board);
+  return i;
+}
+
+/* Anything in progress or queued? */
+static int pending() {
+
+  int i;
+
+  for(i = 0; i < MEAS_GPIB_ENGINE_MAX; i++)
+    if(xacts[i].state >= XACT_QUEUED && xacts[i].state <= XACT_READING) return 1;
+  return 0;
+}
+
+/*
+ * Wait for the next completed transaction.
+ *
+ * timeout = Maximum time to wait in seconds (< 0 = until something completes).
+ *
+ * Returns handle of a completed (or timed out) transaction, which must be
+ * collected with meas_gpib_engine_result(), or -1 if nothing is pending
+ * or the wait timed out.
+ *
+ */
+
+EXPORT int meas_gpib_engine_next(double timeout) {
+
+  struct timespec end;
+  int i;
+
+  if(timeout >= 0.0) deadline_set(&end, timeout);
+  while(1) {
+    for(i = 0; i < MEAS_GPIB_ENGINE_MAX; i++)
+      if(xacts[i].state == XACT_DONE && !xacts[i].reported) {
+	xacts[i].reported = 1;
+	return i;
+      }
+    if(!pending()) return -1;
+    if(timeout >= 0.0 && expired(&end)) return -1;
+    if(!step(timeout < 0.0)) meas_misc_nsleep(0, (long) (1E9 * MEAS_GPIB_ENGINE_POLL));
+  }
+}
+
+/*
+ * Collect the result of a completed transaction and release the handle.
+ *
+ * handle = Transaction handle.
+ * buf    = Reply as received, NUL terminated (at most MEAS_GPIB_ENGINE_REPLYLEN bytes).
+ * status = MEAS_GPIB_OK, MEAS_GPIB_TIMEDOUT or MEAS_GPIB_ERROR.
+ *
+ * Returns the reply length or -1 if the transaction has not completed.
+ *
+ */
+
+EXPORT int meas_gpib_engine_result(int handle, char *buf, int *status) {
+
+  struct xact *x;
+
+  if(handle < 0 || handle >= MEAS_GPIB_ENGINE_MAX || xacts[handle].state != XACT_DONE)
+    meas_err("meas_gpib_engine_result: Transaction not completed.");
+  x = &xacts[handle];
+  memcpy(buf, x->reply, x->len + 1);
+  *status = x->status;
+  x->state = XACT_FREE;
+  return x->len;
+}
+
+/*
+ * Run all pending transactions to completion.
+ *
+ * timeout = Maximum time to wait in seconds (< 0 = no limit).
+ *
+ * Returns 0 when all transactions have completed (collect them with
+ * meas_gpib_engine_result()) or -1 on timeout.
+ *
+ */
+
+EXPORT int meas_gpib_engine_wait_all(double timeout) {
+
+  struct timespec end;
+
+  if(timeout >= 0.0) deadline_set(&end, timeout);
+  while(pending()) {
+    if(timeout >= 0.0 && expired(&end)) return -1;
+    if(!step(timeout < 0.0)) meas_misc_nsleep(0, (long) (1E9 * MEAS_GPIB_ENGINE_POLL));
+  }
+  return 0;
+}
+
+#endif /* GPIB */
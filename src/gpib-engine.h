@@ -0,0 +1,21 @@
+#ifdef GPIB
+/*
+ * GPIB transaction engine limits.
+ *
+ */
+
+/* Maximum number of transactions (queued, active or uncollected) */
+#define MEAS_GPIB_ENGINE_MAX 32
+
+/* Maximum command (including terminator) and reply lengths */
+#define MEAS_GPIB_ENGINE_CMDLEN   256
+#define MEAS_GPIB_ENGINE_REPLYLEN 512
+
+/* Polling interval when more than one bus operation is in progress (s) */
+#define MEAS_GPIB_ENGINE_POLL 100E-6
+
+/* Transaction status */
+#define MEAS_GPIB_OK       0
+#define MEAS_GPIB_TIMEDOUT 1
+#define MEAS_GPIB_ERROR    2
+#endif
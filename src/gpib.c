@@ -5,6 +5,15 @@
  * gpib0  = 1st board,
  * gpib1  = 2nd board, etc.
  *
+ * The functions are thread safe: settings (EOS, timeout, pacing) are kept
+ * per device and every bus operation holds the lock of its board, so
+ * different boards can be driven from different threads in parallel and
+ * board level operations (clear, old_read/old_write) do not interleave
+ * with device I/O. Use meas_gpib_board_lock() to make a sequence of calls
+ * atomic. An asynchronous transfer started with meas_gpib_async_start()
+ * does not keep the board locked; instead, any call that needs the bus
+ * first waits for that transfer to finish.
+ *
  */
 
 #ifdef GPIB
@@ -13,13 +22,209 @@
 #include <gpib/ib.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
 #include "gpib.h"
 #include "misc.h"
 
 /* Up to 5 boards supported */
 static int board_fd[MEAS_GPIB_MAXBOARDS];
-static int been_here = 0;
-static char gpib_eos = MEAS_GPIB_EOS;
+static pthread_mutex_t board_lock[MEAS_GPIB_MAXBOARDS];  /* recursive */
+static pthread_once_t been_here = PTHREAD_ONCE_INIT;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;  /* board_fd[], devs[] allocation, default_eos */
+static char default_eos = MEAS_GPIB_EOS;
+
+/* Per-device state (devices opened with meas_gpib_open()) */
+struct dev {
+  int fd;                   /* device descriptor (-1 = free slot) */
+  int board;                /* board # */
+  int pad;                  /* GPIB address */
+  char eos;                 /* end of string character */
+  double timeout;           /* I/O timeout (s) */
+  double gap;               /* minimum time between bus operations (s; 0 = no pacing) */
+  struct timespec last;     /* end of the last bus operation */
+  char wbuf[MEAS_GPIB_WBUF];/* payload + terminator for short writes */
+  char *abuf;               /* buffer for async writes (must live until the write completes) */
+  int abuf_size;
+  void (*srq)(int, int, void *); /* service request handler (NULL = none) */
+  void *srq_arg;
+};
+
+static struct dev devs[MEAS_GPIB_MAXDEVS];
+
+/* Asynchronous transfer in flight on each board (see meas_gpib_async_start(); board lock) */
+struct async {
+  int fd;                   /* device (-1 = none) */
+  int done;                 /* finished, result not yet collected */
+  int sta;                  /* ibsta and ibcnt of the finished transfer */
+  int cnt;
+};
+
+static struct async inflight[MEAS_GPIB_MAXBOARDS];
+
+static void init() {
+
+  int i;
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  for(i = 0; i < MEAS_GPIB_MAXBOARDS; i++) {
+    board_fd[i] = -1;
+    inflight[i].fd = -1;
+    pthread_mutex_init(&board_lock[i], &attr);
+  }
+  pthread_mutexattr_destroy(&attr);
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++) {
+    devs[i].fd = -1;
+    devs[i].abuf = NULL;
+    devs[i].abuf_size = 0;
+  }
+}
+
+/* Find device slot for fd (NULL if not opened through meas_gpib_open()) */
+static struct dev *dev_find(int fd) {
+
+  int i;
+
+  pthread_once(&been_here, init);
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++)
+    if(devs[i].fd == fd) return &devs[i];
+  return NULL;
+}
+
+/* Wait until the minimum gap since the last bus operation of the device has passed */
+static void pace(struct dev *d) {
+
+  struct timespec now;
+  double left;
+
+  if(!d || d->gap <= 0.0) return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  left = d->gap - ((double) (now.tv_sec - d->last.tv_sec) + 1E-9 * (double) (now.tv_nsec - d->last.tv_nsec));
+  if(left > 0.0) meas_misc_nsleep((time_t) left, (long) (1E9 * (left - (double) (time_t) left)));
+}
+
+/* Bus operation finished */
+static void paced(struct dev *d) {
+
+  if(d && d->gap > 0.0) clock_gettime(CLOCK_MONOTONIC, &d->last);
+}
+
+/*
+ * Has the asynchronous transfer on the board (if any) finished? If block
+ * is set, wait for it (it is aborted if the device times out). Board lock
+ * held.
+ *
+ */
+
+static int settled(int board, int block) {
+
+  struct async *a = &inflight[board];
+  int sta;
+
+  if(a->fd == -1 || a->done) return 1;
+  sta = ibwait(a->fd, block?(CMPL | TIMO):0);
+  if(!(sta & (CMPL | ERR))) {
+    if(!block) return 0;
+    ibstop(a->fd);
+    ibwait(a->fd, CMPL);
+    sta = CMPL | ERR | TIMO;
+  }
+  a->sta = sta;
+  a->cnt = ThreadIbcnt();
+  a->done = 1;
+  return 1;
+}
+
+/* Lock a board for a bus operation (waits for its asynchronous transfer) */
+static void lock_board(int board) {
+
+  pthread_mutex_lock(&board_lock[board]);
+  settled(board, 1);
+}
+
+static void unlock_board(int board) {
+
+  pthread_mutex_unlock(&board_lock[board]);
+}
+
+/* Lock the board of a device for a bus operation (no-op for unknown descriptors) */
+static void lock(struct dev *d) {
+
+  if(d) lock_board(d->board);
+}
+
+static void unlock(struct dev *d) {
+
+  if(d) unlock_board(d->board);
+}
+
+/*
+ * Lock a board for exclusive use by the calling thread (the lock is
+ * recursive, so the meas_gpib functions can still be called while holding
+ * it). Must be released with meas_gpib_board_unlock().
+ *
+ * board = GPIB board # (0, 1, ...).
+ * wait  = 1: wait for the board, 0: return -1 right away if another thread
+ *         holds it or an asynchronous transfer is still on the bus.
+ *
+ */
+
+EXPORT int meas_gpib_board_lock(int board, int wait) {
+
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS)
+    meas_err("meas_gpib_board_lock: Illegal board number.");
+  pthread_once(&been_here, init);
+  if(wait) lock_board(board);
+  else {
+    if(pthread_mutex_trylock(&board_lock[board])) return -1;
+    if(!settled(board, 0)) {
+      unlock_board(board);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Release a board locked with meas_gpib_board_lock().
+ *
+ * board = GPIB board # (0, 1, ...).
+ *
+ */
+
+EXPORT int meas_gpib_board_unlock(int board) {
+
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS)
+    meas_err("meas_gpib_board_unlock: Illegal board number.");
+  unlock_board(board);
+  return 0;
+}
+
+/*
+ * Line terminator for writes.
+ *
+ * fd   = GPIB device descriptor.
+ * term = Terminator is stored here (2 bytes max; not NUL terminated).
+ * crlf = 0: EOS character of the device, 1: CR LF.
+ *
+ * Returns terminator length.
+ *
+ */
+
+EXPORT int meas_gpib_terminator(int fd, char *term, int crlf) {
+
+  struct dev *d;
+
+  if(crlf) {
+    term[0] = '\r';
+    term[1] = '\n';
+    return 2;
+  }
+  term[0] = (d = dev_find(fd))?d->eos:default_eos;
+  return 1;
+}
 
 /*
  * Open GPIB device.
@@ -36,16 +241,19 @@ EXPORT int meas_gpib_open(int board, int id) {
   int fd, i;
   char buf[128];
 
-  if(!been_here) {
-    for(i = 0; i < MEAS_GPIB_MAXBOARDS; i++)
-      board_fd[i] = -1;
-    been_here = 1;
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS) meas_err("meas_gpib_open: Illegal board number.\n");
+  pthread_once(&been_here, init);
+  pthread_mutex_lock(&table_lock);
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++)
+    if(devs[i].fd == -1) break;
+  if(i == MEAS_GPIB_MAXDEVS) {
+    pthread_mutex_unlock(&table_lock);
+    meas_err("meas_gpib_open: Too many devices open (increase MEAS_GPIB_MAXDEVS).");
   }
-
-  if(board >= 5) meas_err("meas_gpib_open: Illegal board number.\n");
   meas_misc_root_on();
-  if((fd = ibdev(board, id, 0, MEAS_GPIB_TIMEOUT, MEAS_GPIB_SENDEOI, gpib_eos)) < 0 ) {
+  if((fd = ibdev(board, id, 0, MEAS_GPIB_TIMEOUT, MEAS_GPIB_SENDEOI, default_eos)) < 0 ) {
     meas_misc_root_off();
+    pthread_mutex_unlock(&table_lock);
     meas_err("meas_gpib_open: Can't open GPIB device.");
   }
   if(board_fd[board] == -1) {  
@@ -53,18 +261,28 @@ EXPORT int meas_gpib_open(int board, int id) {
     if (board == 0) {
       if ((board_fd[board] = ibfind("violet")) < 0 && (board_fd[board] = ibfind(buf)) < 0) {
 	meas_misc_root_off();
+	pthread_mutex_unlock(&table_lock);
 	meas_err("meas_gpib_open: Can't open GPIB board.\n");
       }
     } else {
       if ((board_fd[board] = ibfind(buf)) < 0) {
 	meas_misc_root_off();
+	pthread_mutex_unlock(&table_lock);
 	meas_err("meas_gpib_open: Can't open GPIB board.\n");
       }
     }
     meas_gpib_clear(board);
     usleep(MEAS_GPIB_DELAY); /* TODO: are these waits still needed? */
-    meas_misc_root_off();
   }
+  meas_misc_root_off();
+  devs[i].board = board;
+  devs[i].pad = id;
+  devs[i].eos = default_eos;
+  devs[i].timeout = -1.0;
+  devs[i].gap = 0.0;
+  devs[i].srq = NULL;
+  devs[i].fd = fd;
+  pthread_mutex_unlock(&table_lock);
   return fd;
 }
 
@@ -78,7 +296,55 @@ EXPORT int meas_gpib_open(int board, int id) {
 
 EXPORT int meas_gpib_close(int board, int fd) {
   
-  ibonl(fd, 0); /* offline */
+  struct dev *d;
+
+  pthread_mutex_lock(&table_lock);
+  if((d = dev_find(fd))) {
+    lock(d);
+    ibonl(fd, 0); /* offline */
+    unlock(d);
+    d->fd = -1;
+    if(d->abuf) free(d->abuf);
+    d->abuf = NULL;
+    d->abuf_size = 0;
+  } else ibonl(fd, 0);
+  pthread_mutex_unlock(&table_lock);
+  return 0;
+}
+
+/*
+ * Return the board a device is on (-1 if not opened with meas_gpib_open()).
+ *
+ * fd = GPIB device descriptor.
+ *
+ */
+
+EXPORT int meas_gpib_board(int fd) {
+
+  struct dev *d;
+
+  if(!(d = dev_find(fd))) return -1;
+  return d->board;
+}
+
+/*
+ * Set minimum time between bus operations of a device (for old slow
+ * instruments that lose commands sent too quickly). The time since the
+ * previous operation is measured and the caller sleeps only for what is
+ * left of the gap. Default is no pacing.
+ *
+ * fd  = GPIB device descriptor.
+ * gap = Minimum gap in seconds (0 = no pacing).
+ *
+ */
+
+EXPORT int meas_gpib_pacing(int fd, double gap) {
+
+  struct dev *d;
+
+  if(!(d = dev_find(fd))) meas_err("meas_gpib_pacing: Device not open.");
+  d->gap = gap;
+  d->last.tv_sec = d->last.tv_nsec = 0;
   return 0;
 }
 
@@ -97,12 +363,17 @@ EXPORT int meas_gpib_close(int board, int fd) {
 
 EXPORT int meas_gpib_set(int fd, int mode) {
 
+  struct dev *d = dev_find(fd);
+
+  lock(d);
   (void) ibeos(fd, mode);
+  unlock(d);
   return 0;
 }
 
 /*
- * Set end of string character (affects all devices and only for operations after this call).
+ * Set default end of string character for devices opened after this call
+ * (use meas_gpib_eos() to change it for an open device).
  *
  * eos = End of string character.
  *
@@ -110,7 +381,27 @@ EXPORT int meas_gpib_set(int fd, int mode) {
 
 EXPORT int meas_gpib_set_eos(char eos) {
 
-  gpib_eos = eos;
+  pthread_mutex_lock(&table_lock);
+  default_eos = eos;
+  pthread_mutex_unlock(&table_lock);
+  return 0;
+}
+
+/*
+ * Set end of string character of a device (sent at the end of writes
+ * with crlf = 0).
+ *
+ * fd  = GPIB device descriptor.
+ * eos = End of string character.
+ *
+ */
+
+EXPORT int meas_gpib_eos(int fd, char eos) {
+
+  struct dev *d;
+
+  if(!(d = dev_find(fd))) meas_err("meas_gpib_eos: Device not open.");
+  d->eos = eos;
   return 0;
 }
 
@@ -125,6 +416,7 @@ EXPORT int meas_gpib_set_eos(char eos) {
 EXPORT int meas_gpib_timeout(int fd, double value) {
 
   int val;
+  struct dev *d;
   
   if(value == 0.0) val = 0;
   else if(value <= 10.0E-6) val = 1;
@@ -146,10 +438,45 @@ EXPORT int meas_gpib_timeout(int fd, double value) {
   else if(value <= 1000.0) val = 17;
   else meas_err("meas_gpib_timeout: illegal device timeout value.");
   
+  if((d = dev_find(fd))) d->timeout = value;
+  lock(d);
   (void) ibtmo(fd, val); /* see ibtmo documentation for value */
+  unlock(d);
   return 0;
 }
 
+/*
+ * Read a message (up to EOI or EOS) from GPIB device into a buffer of
+ * given size. Trailing CR/LF is removed.
+ *
+ * fd     = GPIB device descriptor.
+ * buf    = Buffer for output (NUL terminated).
+ * maxlen = Size of buf.
+ *
+ * Returns the message length.
+ *
+ */
+
+EXPORT int meas_gpib_read_max(int fd, char *buf, int maxlen) {
+
+  int len;
+  struct dev *d = dev_find(fd);
+
+  pace(d);
+  lock(d);
+  if(ibrd(fd, buf, maxlen - 1) & ERR) {
+    unlock(d);
+    buf[0] = 0;
+    meas_err("gpib: read failed.");
+  }
+  len = ThreadIbcnt();
+  unlock(d);
+  paced(d);
+  while(len > 0 && (buf[len-1] == '\n' || buf[len-1] == '\r')) len--;
+  buf[len] = 0;
+  return len;
+}
+
 /*
  * Read string from GPIB device.
  *
@@ -162,13 +489,37 @@ EXPORT int meas_gpib_read(int fd, char *buf) {
 
   char *tmp;
 
-  usleep(MEAS_GPIB_DELAY);
-  if(ibrd(fd, buf, MEAS_GPIB_BUF_SIZE) < 0) 
-    meas_err("gpib: read failed.");
+  if(meas_gpib_read_max(fd, buf, MEAS_GPIB_BUF_SIZE) < 0) return -1;
   if((tmp = strchr(buf, '\r'))) *tmp = 0;
   return 0;
 }
 
+/* Read up to count bytes (board locked by the caller). Returns # of bytes read or -1; *end set at EOI/EOS. */
+static int read_some(struct dev *d, int fd, char *buf, int count, int *end) {
+
+  int sta;
+
+  pace(d);
+  sta = ibrd(fd, buf, count);
+  paced(d);
+  if(sta & ERR) return -1;
+  *end = (sta & END)?1:0;
+  return ThreadIbcnt();
+}
+
+/* Fill buf with exactly count bytes (less only if the message ends). Returns # of bytes read or -1. */
+static int read_full(struct dev *d, int fd, char *buf, int count, int *end) {
+
+  int len = 0, n;
+
+  *end = 0;
+  while(len < count && !*end) {
+    if((n = read_some(d, fd, buf + len, count - len, end)) < 0) return -1;
+    len += n;
+  }
+  return len;
+}
+
 /*
  * Read N bytes from GPIB device.
  *
@@ -176,30 +527,139 @@ EXPORT int meas_gpib_read(int fd, char *buf) {
  * buf    = Buffer for output.
  * nbytes = Number of bytes to read.
  *
+ * Returns zero on success and -1 on error, timeout or if the message
+ * ends before nbytes bytes.
+ *
  */
 
 EXPORT int meas_gpib_read_n(int fd, char *buf, int nbytes) {
 
-  char *tmp;
-  int len, tmp2, err;
-
-  tmp = buf;
-  len = 0;
-  while (1) {
-    usleep(MEAS_GPIB_DELAY);
-    ibrd(fd, tmp, nbytes);
-    if(iberr) {
-      if(iberr != EABO) {
-	fprintf(stderr, "meas_gpib_read_n: read failed (err = %d).\n", iberr);
-	continue;
+  struct dev *d = dev_find(fd);
+  int len, end;
+
+  lock(d);
+  len = read_full(d, fd, buf, nbytes, &end);
+  unlock(d);
+  if(len < 0) meas_err("meas_gpib_read_n: read failed or timed out.");
+  if(len < nbytes) meas_err("meas_gpib_read_n: message ended early.");
+  return 0;
+}
+
+/* Read binary block (see below) with the board locked. tmp = chunk buffer if buf is NULL. */
+static int read_block(struct dev *d, int fd, char **buf, int *size, int (*chunk)(char *, int, int, void *), void *arg, char *tmp) {
+
+  char c, hdr[16], *dst;
+  int ndigits, len = -1, n, offset = 0, end = 0, want;
+
+  /* header */
+  do {
+    if(read_full(d, fd, &c, 1, &end) != 1 || (end && c != '#')) return -1;
+  } while(c != '#');
+  if(read_full(d, fd, &c, 1, &end) != 1 || end || c < '0' || c > '9') return -1;
+  if((ndigits = c - '0')) {
+    if(read_full(d, fd, hdr, ndigits, &end) != ndigits || end) return -1;
+    hdr[ndigits] = 0;
+    len = atoi(hdr);
+  }
+  /* data */
+  while(len < 0 || offset < len) {
+    want = MEAS_GPIB_BLOCK_CHUNK;
+    if(len >= 0 && len - offset < want) want = len - offset;
+    if(buf) {
+      if(!*buf || *size < offset + want) {
+	n = (len >= 0)?len:(2 * (offset + want));
+	if(!(dst = (char *) realloc(*buf, n))) return -1;
+	*buf = dst;
+	*size = n;
       }
-      /* Hopefully the device trasferred everything and we can read the data */
-      tmp2 = nbytes;
-    } else tmp2 = ThreadIbcnt();
-    tmp += tmp2;
-    len += tmp2;
-    if(len >= nbytes) break;
+      dst = *buf + offset;
+    } else dst = tmp;
+    if((n = read_full(d, fd, dst, want, &end)) < 0) return -1;
+    if(len >= 0 && n < want) return -1;   /* message ended early */
+    if(chunk && n > 0 && (*chunk)(dst, n, offset, arg) < 0) return -1;
+    offset += n;
+    if(len < 0 && end) break;
   }
+  /* message terminator */
+  if(len >= 0 && !end) read_full(d, fd, &c, 1, &end);
+  return offset;
+}
+
+/*
+ * Read IEEE 488.2 binary block (#<n><length><data>, or #0<data> terminated
+ * by EOI) from GPIB device. Anything before the '#' (such as a response
+ * header) is skipped, and the message terminator after the data is consumed.
+ *
+ * The data is read in chunks of MEAS_GPIB_BLOCK_CHUNK bytes and stored in
+ * *buf and/or passed to the chunk function:
+ *
+ * fd    = GPIB device descriptor.
+ * buf   = Pointer to data buffer, NULL if only the chunk function is used.
+ *         If *buf is NULL or *size is too small, the buffer is (re)allocated
+ *         with malloc()/realloc() (to be freed by the caller).
+ * size  = Pointer to the size of *buf (updated when reallocated).
+ * chunk = Function called as chunk(data, len, offset, arg) for every chunk
+ *         (NULL = none); len is a multiple of MEAS_GPIB_BLOCK_CHUNK except
+ *         for the last chunk, offset is the position in the block. Return
+ *         value < 0 aborts the transfer.
+ * arg   = Passed to the chunk function.
+ *
+ * Returns the length of the data or -1 on error.
+ *
+ */
+
+EXPORT int meas_gpib_read_block(int fd, char **buf, int *size, int (*chunk)(char *, int, int, void *), void *arg) {
+
+  struct dev *d = dev_find(fd);
+  char *tmp = NULL;
+  int len;
+
+  if(!buf && !chunk) meas_err("meas_gpib_read_block: Nowhere to store the data.");
+  if(!buf && !(tmp = (char *) malloc(MEAS_GPIB_BLOCK_CHUNK))) meas_err("meas_gpib_read_block: Out of memory.");
+  lock(d);
+  len = read_block(d, fd, buf, size, chunk, arg, tmp);
+  unlock(d);
+  if(tmp) free(tmp);
+  if(len < 0) meas_err("meas_gpib_read_block: read failed.");
+  return len;
+}
+
+/*
+ * Write data to GPIB device.
+ *
+ * fd   = GPIB device descriptor.
+ * buf  = Data to write (need not be NUL terminated).
+ * len  = Number of bytes in buf.
+ * crlf = 0: use CR, 1: use CR LF as line end.
+ *
+ * Short writes are assembled in a per-device buffer and sent with one
+ * ibwrt(). Longer ones are sent in place with EOI suppressed, followed by
+ * the terminator with EOI, so the data is never copied.
+ *
+ */
+
+EXPORT int meas_gpib_write_n(int fd, char *buf, int len, int crlf) {
+
+  char term[2];
+  int tlen, err;
+  struct dev *d = dev_find(fd);
+
+  tlen = meas_gpib_terminator(fd, term, crlf);
+  pace(d);
+  lock(d);
+  if(d && len + tlen <= MEAS_GPIB_WBUF) {
+    memcpy(d->wbuf, buf, len);
+    memcpy(d->wbuf + len, term, tlen);
+    err = (ibwrt(fd, d->wbuf, len + tlen) & ERR);
+  } else {
+    ibeot(fd, 0);
+    err = (ibwrt(fd, buf, len) & ERR);
+    ibeot(fd, MEAS_GPIB_SENDEOI);
+    if(!err) err = (ibwrt(fd, term, tlen) & ERR);
+  }
+  unlock(d);
+  paced(d);
+  if(err) meas_err("meas_gpib_write: write failed.");
   return 0;
 }
 
@@ -214,26 +674,7 @@ EXPORT int meas_gpib_read_n(int fd, char *buf, int nbytes) {
 
 EXPORT int meas_gpib_write(int fd, char *buf, int crlf) {
   
-  char tmp[MEAS_GPIB_BUF_SIZE];
-  int len;
-
-  if(crlf) { /* CR LF */
-    strcpy(tmp, buf);
-    len = strlen(buf);
-    tmp[len] = '\r';
-    tmp[len+1] = '\n';
-    usleep(MEAS_GPIB_DELAY);
-    if(ibwrt(fd, tmp, len+2) < 0)
-      meas_err("meas_gpib_write: write failed.");
-  } else {
-    strcpy(tmp, buf);
-    len = strlen(buf);
-    tmp[len] = gpib_eos;
-    usleep(MEAS_GPIB_DELAY);
-    if(ibwrt(fd, tmp, len+1) < 0)
-      meas_err("meas_gpib_write: write failed.");
-  }
-  return 0;
+  return meas_gpib_write_n(fd, buf, strlen(buf), crlf);
 }
 
 /*
@@ -246,7 +687,14 @@ EXPORT int meas_gpib_write(int fd, char *buf, int crlf) {
 
 EXPORT int meas_gpib_cmd(int fd, char cmd) {
 
+  struct dev *d = dev_find(fd);
+
+  /* board descriptors are the board numbers */
+  if(!d && fd >= 0 && fd < MEAS_GPIB_MAXBOARDS) lock_board(fd);
+  lock(d);
   ibcmd(fd, &cmd, 1);
+  unlock(d);
+  if(!d && fd >= 0 && fd < MEAS_GPIB_MAXBOARDS) unlock_board(fd);
   return 0;
 }
 
@@ -259,12 +707,35 @@ EXPORT int meas_gpib_cmd(int fd, char cmd) {
 
 EXPORT int meas_gpib_clear(int board) {
 
-  if(board_fd[board] == -1)
+  pthread_once(&been_here, init);
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS || board_fd[board] == -1)
     meas_err("meas_gpib_clear: non-existent board.");
+  lock_board(board);
   ibsic(board_fd[board]);   /* Inteface clear */
   meas_gpib_cmd(board, DCL);     /* Device clear */
   ibsre(board_fd[board],1); /* Everyone to remote */
   usleep(MEAS_GPIB_DELAY);
+  unlock_board(board);
+  return 0;
+}
+
+/*
+ * Issue selected device clear (clears the input and output queues of
+ * the device).
+ *
+ * fd = GPIB device descriptor.
+ *
+ */
+
+EXPORT int meas_gpib_device_clear(int fd) {
+
+  int sta;
+  struct dev *d = dev_find(fd);
+
+  lock(d);
+  sta = ibclr(fd);
+  unlock(d);
+  if(sta & ERR) meas_err("meas_gpib_device_clear: Device clear failed.");
   return 0;
 }
 
@@ -276,12 +747,15 @@ EXPORT int meas_gpib_clear(int board) {
 
 EXPORT int meas_gpib_old_read(int board, int id, char *buf, int len) {
 
-  if(board_fd[board] == -1)
+  pthread_once(&been_here, init);
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS || board_fd[board] == -1)
     meas_err("meas_gpib_old_read: non-existent board.");
+  lock_board(board);
   meas_gpib_cmd(board_fd[board], 0x20);     /* board (id = 0) as listener */
   meas_gpib_cmd(board_fd[board], 0x40 + id);/* instrument (id) as talker */
   ibrd(board_fd[board], buf, len);
   meas_gpib_cmd(board_fd[board], UNT);
+  unlock_board(board);
   return 0;
 }
 
@@ -293,12 +767,15 @@ EXPORT int meas_gpib_old_read(int board, int id, char *buf, int len) {
 
 EXPORT int meas_gpib_old_write(int board, int id, char *buf, int len) {
 
-  if(board_fd[board] == -1)
+  pthread_once(&been_here, init);
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS || board_fd[board] == -1)
     meas_err("meas_gpib_old_write: non-existent board.");
+  lock_board(board);
   meas_gpib_cmd(board_fd[board], UNL);
   meas_gpib_cmd(board_fd[board], 0x20 + id); /* listener = device with id */
   meas_gpib_cmd(board_fd[board], 0x40);      /* talker = board (id 0) */
   ibwrt(board_fd[board], buf, len);
+  unlock_board(board);
   return 0;
 }
 
@@ -313,7 +790,53 @@ EXPORT int meas_gpib_old_write(int board, int id, char *buf, int len) {
 
 EXPORT int meas_gpib_async_read_n(int fd, char *buf, int nbytes) {
 
+  struct dev *d = dev_find(fd);
+
+  pace(d);
+  lock(d);
   ibrda(fd, buf, nbytes);
+  unlock(d);
+  paced(d);
+  return 0;
+}
+
+/*
+ * Write data to GPIB device (async).
+ *
+ * fd   = GPIB device descriptor.
+ * buf  = Data to write (need not be NUL terminated).
+ * len  = Number of bytes in buf.
+ * crlf = 0: use CR, 1: use CR LF as line end.
+ *
+ * The data is copied to a per-device buffer that stays valid until the
+ * next async write or close, so buf may be reused immediately.
+ *
+ */
+
+EXPORT int meas_gpib_async_write_n(int fd, char *buf, int len, int crlf) {
+
+  int tlen;
+  struct dev *d = dev_find(fd);
+
+  if(!d) meas_err("meas_gpib_async_write: Device not open.");
+  if(len + 2 > d->abuf_size) {
+    if(d->abuf) free(d->abuf);
+    d->abuf_size = (len + 2 > MEAS_GPIB_WBUF)?(len + 2):MEAS_GPIB_WBUF;
+    if(!(d->abuf = (char *) malloc(d->abuf_size))) {
+      d->abuf_size = 0;
+      meas_err("meas_gpib_async_write: Out of memory.");
+    }
+  }
+  memcpy(d->abuf, buf, len);
+  tlen = meas_gpib_terminator(fd, d->abuf + len, crlf);
+  pace(d);
+  lock(d);
+  if(ibwrta(fd, d->abuf, len + tlen) & ERR) {
+    unlock(d);
+    meas_err("meas_gpib_async_write: write failed.");
+  }
+  unlock(d);
+  paced(d);
   return 0;
 }
 
@@ -328,26 +851,279 @@ EXPORT int meas_gpib_async_read_n(int fd, char *buf, int nbytes) {
 
 EXPORT int meas_gpib_async_write(int fd, char *buf, int crlf) {
   
-  char tmp[MEAS_GPIB_BUF_SIZE];
-  int len;
- 
-  if(crlf) { /* CR LF */
-    strcpy(tmp, buf);
-    len = strlen(buf);
-    tmp[len] = '\r';
-    tmp[len+1] = '\n';
-    usleep(MEAS_GPIB_DELAY);
-    if(ibwrta(fd, tmp, len+2) < 0)
-      meas_err("meas_gpib_write: write failed.");
-  } else {
-    strcpy(tmp, buf);
-    len = strlen(buf);
-    tmp[len] = gpib_eos;
-    usleep(MEAS_GPIB_DELAY);
-    if(ibwrta(fd, tmp, len+1) < 0)
-      meas_err("meas_gpib_write: write failed.");
+  return meas_gpib_async_write_n(fd, buf, strlen(buf), crlf);
+}
+
+/*
+ * Start an asynchronous transfer (ibwrta() or ibrda()) without waiting
+ * for the board. Only one such transfer can be in flight on a board; its
+ * result must be collected with meas_gpib_async_poll(). The board is not
+ * kept locked meanwhile, but every other call that uses the bus waits for
+ * the transfer to finish first.
+ *
+ * fd    = GPIB device descriptor.
+ * buf   = Data to write / buffer for the data read (must stay valid until
+ *         the transfer has finished).
+ * len   = Number of bytes to write / maximum number of bytes to read.
+ * write = 1: write, 0: read.
+ *
+ * Returns 1 if the transfer was started, 0 if the board is busy (locked by
+ * another thread or with a transfer in flight; try again later) or -1 on
+ * error.
+ *
+ */
+
+EXPORT int meas_gpib_async_start(int fd, char *buf, int len, int write) {
+
+  struct dev *d = dev_find(fd);
+  int sta;
+
+  if(!d) meas_err("meas_gpib_async_start: Device not open.");
+  if(pthread_mutex_trylock(&board_lock[d->board])) return 0;
+  if(inflight[d->board].fd != -1) {
+    unlock_board(d->board);
+    return 0;
+  }
+  sta = write?ibwrta(fd, buf, len):ibrda(fd, buf, len);
+  if(!(sta & ERR)) {
+    inflight[d->board].fd = fd;
+    inflight[d->board].done = 0;
+  }
+  unlock_board(d->board);
+  return (sta & ERR)?-1:1;
+}
+
+/*
+ * Check the asynchronous transfer started with meas_gpib_async_start().
+ *
+ * board = GPIB board # (0, 1, ...).
+ * block = 1: wait until it finishes or the device times out, 0: just check.
+ * sta   = ibsta of the finished transfer.
+ * cnt   = Number of bytes transferred.
+ *
+ * Returns 1 if the transfer has finished (the board is then free for the
+ * next one), 0 if it is still in progress or -1 on error.
+ *
+ */
+
+EXPORT int meas_gpib_async_poll(int board, int block, int *sta, int *cnt) {
+
+  struct async *a;
+
+  pthread_once(&been_here, init);
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS || inflight[board].fd == -1)
+    meas_err("meas_gpib_async_poll: No transfer in progress.");
+  a = &inflight[board];
+  pthread_mutex_lock(&board_lock[board]);
+  if(!a->done) {
+    *sta = ibwait(a->fd, block?(CMPL | TIMO):0);
+    if(*sta & (CMPL | ERR)) {
+      a->sta = *sta;
+      a->cnt = ThreadIbcnt();
+      a->done = 1;
+    }
+  }
+  if(!a->done) {
+    unlock_board(board);
+    return 0;
+  }
+  *sta = a->sta;
+  *cnt = a->cnt;
+  a->fd = -1;
+  unlock_board(board);
+  return 1;
+}
+
+/*
+ * Abort the asynchronous transfer started with meas_gpib_async_start()
+ * (its result is discarded).
+ *
+ * board = GPIB board # (0, 1, ...).
+ *
+ */
+
+EXPORT int meas_gpib_async_stop(int board) {
+
+  struct async *a;
+
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS)
+    meas_err("meas_gpib_async_stop: Illegal board number.");
+  pthread_once(&been_here, init);
+  a = &inflight[board];
+  pthread_mutex_lock(&board_lock[board]);
+  if(a->fd != -1 && !a->done) {
+    ibstop(a->fd);
+    ibwait(a->fd, CMPL);
+  }
+  a->fd = -1;
+  unlock_board(board);
+  return 0;
+}
+
+/*
+ * Trigger a group of devices simultaneously with a single Group Execute
+ * Trigger (GET): the devices on each board are addressed as listeners and
+ * sent one GET. Devices on different boards are triggered one board after
+ * another.
+ *
+ * The devices must be set up to wait for a bus trigger (e.g. with
+ * meas_hp34401a_set_trigger_source(unit, MEAS_HP34401A_TRIGGER_BUS) and
+ * meas_hp34401a_arm()). The readings can then be collected concurrently
+ * with the transaction engine:
+ *
+ *   meas_gpib_trigger(fds, n);
+ *   for(i = 0; i < n; i++) meas_gpib_engine_submit(fds[i], "FETC?", 1, 2.0);
+ *   meas_gpib_engine_wait_all(-1.0);
+ *
+ * fds = GPIB device descriptors.
+ * n   = Number of devices.
+ *
+ */
+
+EXPORT int meas_gpib_trigger(int *fds, int n) {
+
+  unsigned char cmd[2 + MEAS_GPIB_MAXDEVS + 1];
+  int b, i, len, sta;
+  struct dev *d;
+
+  for(i = 0; i < n; i++)
+    if(!dev_find(fds[i])) meas_err("meas_gpib_trigger: Device not open.");
+  if(n > MEAS_GPIB_MAXDEVS) meas_err("meas_gpib_trigger: Too many devices.");
+  for(b = 0; b < MEAS_GPIB_MAXBOARDS; b++) {
+    len = 0;
+    cmd[len++] = UNL;
+    for(i = 0; i < n; i++)
+      if((d = dev_find(fds[i]))->board == b) cmd[len++] = LAD + d->pad;
+    if(len == 1) continue;
+    cmd[len++] = GET;
+    cmd[len++] = UNL;
+    lock_board(b);
+    sta = ibcmd(board_fd[b], cmd, len);
+    unlock_board(b);
+    if(sta & ERR) meas_err("meas_gpib_trigger: GET failed.");
   }
   return 0;
 }
 
+/*
+ * Serial poll device.
+ *
+ * fd = GPIB device descriptor.
+ *
+ * Returns the status byte (MEAS_GPIB_STB_*) or -1 on error.
+ *
+ */
+
+EXPORT int meas_gpib_serial_poll(int fd) {
+
+  char stb;
+  int sta;
+  struct dev *d = dev_find(fd);
+
+  lock(d);
+  sta = ibrsp(fd, &stb);
+  unlock(d);
+  if(sta & ERR)
+    meas_err("meas_gpib_serial_poll: serial poll failed.");
+  return (unsigned char) stb;
+}
+
+/*
+ * Enable service requests from an IEEE 488.2 device (*CLS, *ESE, *SRE)
+ * and register a handler for them (see meas_gpib_srq_wait()).
+ *
+ * fd      = GPIB device descriptor.
+ * sre     = Service request enable mask (MEAS_GPIB_STB_*; e.g. MEAS_GPIB_STB_MAV
+ *           to request service when a reply is available).
+ * ese     = Standard event status enable mask (MEAS_GPIB_ESE_*; e.g.
+ *           MEAS_GPIB_ESE_OPC together with MEAS_GPIB_STB_ESB in sre to
+ *           request service when *OPC completes).
+ * crlf    = 0: use CR, 1: use CR LF as line end.
+ * handler = Called as handler(fd, status_byte, arg) when the device requests
+ *           service (NULL = disable service requests).
+ * arg     = Passed to the handler.
+ *
+ */
+
+EXPORT int meas_gpib_srq_enable(int fd, int sre, int ese, int crlf, void (*handler)(int, int, void *), void *arg) {
+
+  struct dev *d;
+  char buf[64];
+
+  if(!(d = dev_find(fd))) meas_err("meas_gpib_srq_enable: Device not open.");
+  if(!handler) sre = ese = 0;
+  if(meas_gpib_write(fd, "*CLS", crlf) < 0) return -1;
+  sprintf(buf, "*ESE %d", ese);
+  if(meas_gpib_write(fd, buf, crlf) < 0) return -1;
+  sprintf(buf, "*SRE %d", sre);
+  if(meas_gpib_write(fd, buf, crlf) < 0) return -1;
+  /* the driver must not serial poll behind our back (it would clear the SRQ line) */
+  lock(d);
+  ibconfig(board_fd[d->board], IbcAUTOPOLL, 0);
+  unlock(d);
+  d->srq = handler;
+  d->srq_arg = arg;
+  return 0;
+}
+
+/*
+ * Wait for a service request on a board, serial poll the devices on it and
+ * call the handlers of the devices that requested service.
+ *
+ * board   = GPIB board # (0, 1, ...).
+ * timeout = Maximum time to wait in seconds (0 = just check, < 0 = no limit).
+ *
+ * Returns the number of handlers called (0 = timed out) or -1 on error.
+ *
+ */
+
+EXPORT int meas_gpib_srq_wait(int board, double timeout) {
+
+  int i, sta, n = 0, old_tmo, stbs[MEAS_GPIB_MAXDEVS], fds[MEAS_GPIB_MAXDEVS];
+  void (*handlers[MEAS_GPIB_MAXDEVS])(int, int, void *);
+  void *args[MEAS_GPIB_MAXDEVS];
+  char stb;
+
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++)
+    fds[i] = stbs[i] = -1;
+  pthread_once(&been_here, init);
+  if(board < 0 || board >= MEAS_GPIB_MAXBOARDS || board_fd[board] == -1)
+    meas_err("meas_gpib_srq_wait: non-existent board.");
+  /* waiting does not use the bus, so the board is not locked for it */
+  if(timeout == 0.0) sta = ibwait(board_fd[board], 0);
+  else {
+    /* the board timeout limits the wait; put the old one back afterwards */
+    if(ibask(board_fd[board], IbaTMO, &old_tmo) & ERR) meas_err("meas_gpib_srq_wait: cannot read board timeout.");
+    if(meas_gpib_timeout(board_fd[board], (timeout < 0.0)?0.0:timeout) < 0) return -1;
+    sta = ibwait(board_fd[board], SRQI | TIMO);
+    ibtmo(board_fd[board], old_tmo);
+  }
+  if(sta & ERR) meas_err("meas_gpib_srq_wait: wait failed.");
+  if(!(sta & SRQI)) return 0;
+  /* poll every device on the board: any of them may hold the SRQ line */
+  pthread_mutex_lock(&table_lock);
+  lock_board(board);
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++) {
+    if(devs[i].fd == -1 || devs[i].board != board) continue;
+    if(ibrsp(devs[i].fd, &stb) & ERR) continue;
+    if(stb & MEAS_GPIB_STB_RQS) stbs[i] = (unsigned char) stb;
+    else stbs[i] = -1;
+  }
+  unlock_board(board);
+  /* handlers are called without locks held, so take copies of them now */
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++) {
+    if(devs[i].fd == -1 || devs[i].board != board || stbs[i] < 0 || !devs[i].srq) continue;
+    fds[i] = devs[i].fd;
+    handlers[i] = devs[i].srq;
+    args[i] = devs[i].srq_arg;
+  }
+  pthread_mutex_unlock(&table_lock);
+  for(i = 0; i < MEAS_GPIB_MAXDEVS; i++)
+    if(fds[i] != -1) {
+      (*handlers[i])(fds[i], stbs[i], args[i]);
+      n++;
+    }
+  return n;
+}
+
 #endif /* GPIB */
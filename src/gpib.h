@@ -10,9 +10,30 @@
 #define MEAS_GPIB_SENDEOI 1
 #define MEAS_GPIB_EOS '\r'
 
-/* In microsec */
+/* Settling delay after board initialization (in microsec) */
 #define MEAS_GPIB_DELAY 10
 
+/* Transfer size for binary blocks (meas_gpib_read_block()) */
+#define MEAS_GPIB_BLOCK_CHUNK 65536
+
+/* Per-device buffer for short writes (payload + terminator) */
+#define MEAS_GPIB_WBUF 256
+
+/* Maximum number of open devices */
+#define MEAS_GPIB_MAXDEVS 32
+
+/* IEEE 488.2 status byte bits */
+#define MEAS_GPIB_STB_MAV 0x10  /* message available */
+#define MEAS_GPIB_STB_ESB 0x20  /* standard event status summary */
+#define MEAS_GPIB_STB_RQS 0x40  /* device requested service */
+
+/* IEEE 488.2 standard event status bits */
+#define MEAS_GPIB_ESE_OPC 0x01  /* operation complete */
+#define MEAS_GPIB_ESE_QYE 0x04  /* query error */
+#define MEAS_GPIB_ESE_DDE 0x08  /* device dependent error */
+#define MEAS_GPIB_ESE_EXE 0x10  /* execution error */
+#define MEAS_GPIB_ESE_CME 0x20  /* command error */
+
 /* Maximum number of boards */
 #define MEAS_GPIB_MAXBOARDS 5
 #endif
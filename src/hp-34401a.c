@@ -3,17 +3,19 @@
  *
  */
 
-#ifdef GPIB
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "hp-34401a.h"
-#include "gpib.h"
+#include "transport.h"
+#include "shadow.h"
 #include "misc.h"
+#ifdef GPIB
+#include "gpib.h"
+#endif
 
-/* Up to 5 devices supported */
+/* Up to 5 devices supported (transport descriptors) */
 static int hp34401a_fd[5] = {-1, -1, -1, -1, -1};
 
 static char *modes[] = {"CONF:VOLT:AC", "CONF:VOLT:DC", "CONF:RES", "CONF:CURR:AC", "CONF:CURR:DC", "CONF:FREQ", "CONF:PER", 0};
@@ -27,17 +29,64 @@ static char *itime[] = {0, "SENS:VOLT:DC:NPLC", "SENS:RES:NPLC", 0, "SENS:CURR:D
 static char *itime_opts[] = {/* int. times */ "0.02", "0.2", "1.0", "10.0", "100.0", /* freq & period */ "0.010", "0.1", "1.0", 0};
 static char *setmodes[] = {"SENS:FUNC \"VOLT:AC\"", "SENS:FUNC \"VOLT:DC\"", "SENS:FUNC \"RES\"", "SENS:FUNC \"CURR:AC\"", "SENS:FUNC \"CURR:DC\"", "SENS:FUNC \"FREQ\"", "SENS:FUNC \"PER\"", 0};
 static char *trigger_sources[] = {"BUS", "IMM", "EXT", 0};
+static int hp34401a_shadow[5] = {-1, -1, -1, -1, -1};
+
+/* Send a setting unless the instrument already has it (the SCPI header identifies the setting) */
+static int set(int unit, char *cmd) {
+
+  int keylen = strcspn(cmd, " ");
+
+  if(!meas_shadow_update(hp34401a_shadow[unit], cmd, keylen)) return 0;
+  if(meas_transport_write(hp34401a_fd[unit], cmd) < 0) {
+    meas_shadow_forget(hp34401a_shadow[unit], cmd, keylen);
+    return -1;
+  }
+  return 0;
+}
 
 /* Initialize instrument (dev = GPIB id) */
 EXPORT int meas_hp34401a_open(int unit, int board, int dev) {
 
+  int t;
+
   if(hp34401a_fd[unit] == -1) {
-    hp34401a_fd[unit] = meas_gpib_open(board, dev);
-    meas_gpib_timeout(hp34401a_fd[unit], 1.0);
-  }
+    if((t = meas_transport_gpib(board, dev, MEAS_HP34401A_CRLF)) < 0) return -1;
+    meas_transport_timeout(t, 1.0);
+  } else t = hp34401a_fd[unit];
+  return meas_hp34401a_open_transport(unit, t);
+}
+
+/*
+ * Initialize instrument on an open transport (see transport.c), e.g. RS232
+ * (set the meter to 9600 baud, 8 bits, no parity and use
+ * meas_transport_terminator(t, "\r\n", '\n')).
+ *
+ * t = Transport descriptor.
+ *
+ */
+
+EXPORT int meas_hp34401a_open_transport(int unit, int t) {
+
+  hp34401a_fd[unit] = t;
+  if(hp34401a_shadow[unit] == -1) hp34401a_shadow[unit] = meas_shadow_open();
+  meas_shadow_invalidate(hp34401a_shadow[unit]);
+  if(meas_transport_type(t) != MEAS_TRANSPORT_GPIB)
+    meas_transport_write(t, "SYST:REM"); /* RS232 commands are ignored in local mode */
   /* we don't need the unit to do data processing since the computer can do this... */
-  meas_gpib_write(hp34401a_fd[unit], "CALC:STAT OFF", MEAS_HP34401A_CRLF); /* turn off math processing */
-  return 0;
+  return set(unit, "CALC:STAT OFF"); /* turn off math processing */
+}
+
+/*
+ * Forget the settings sent to the instrument, so that they are all sent
+ * again (call after changing settings on the front panel or with *RST).
+ *
+ */
+
+EXPORT int meas_hp34401a_invalidate(int unit) {
+
+  if(hp34401a_fd[unit] == -1)
+    meas_err("meas_hp34401a_invalidate: Non-existent unit.");
+  return meas_shadow_invalidate(hp34401a_shadow[unit]);
 }
 
 /*
@@ -53,7 +102,7 @@ EXPORT int meas_hp34401a_open(int unit, int board, int dev) {
 
 EXPORT int meas_hp34401a_set_ac_filter(int unit, int freq) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_set_ac_filter: Non-existent unit.");
@@ -70,8 +119,7 @@ EXPORT int meas_hp34401a_set_ac_filter(int unit, int freq) {
   default:
     meas_err("meas_hp34401a_set_ac_filter: Invalid AC signal filter.");
   }
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -94,7 +142,7 @@ EXPORT int meas_hp34401a_set_ac_filter(int unit, int freq) {
 
 EXPORT int meas_hp34401a_set_autoscale(int unit, int autos, int setting) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1) 
     meas_err("meas_hp34401a_set_autoscale: Non-existent unit.");
@@ -103,8 +151,7 @@ EXPORT int meas_hp34401a_set_autoscale(int unit, int autos, int setting) {
   if(setting < 0 || setting > 1)
     meas_err("meas_hp34401a_set_autoscale: Unknown autoscale setting.");
   sprintf(buf, "%s %s", autoscale[autos], setting?"ON":"OFF");
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -119,7 +166,7 @@ EXPORT int meas_hp34401a_set_autoscale(int unit, int autos, int setting) {
 
 EXPORT int meas_hp34401a_set_impedance(int unit, int autos) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_set_impedance: Non-existent unit.");
@@ -133,8 +180,7 @@ EXPORT int meas_hp34401a_set_impedance(int unit, int autos) {
   default:
     meas_err("meas_hp34401a_set_impedance: Invalid impedance mode.");
   }
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -183,7 +229,7 @@ EXPORT int meas_hp34401a_set_impedance(int unit, int autos) {
 
 EXPORT int meas_hp34401a_set_resolution(int unit, int what, int scale, double resol) {
 
-  char buf[MEAS_GPIB_BUF_SIZE], res[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE], res[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_set_resolution: Non-existent unit.");
@@ -199,8 +245,10 @@ EXPORT int meas_hp34401a_set_resolution(int unit, int what, int scale, double re
   else if(resol == MEAS_HP34401A_RESOL_MIN) sprintf(res, "MIN");
   else sprintf(res, "%lf", resol);
   sprintf(buf, "%s %s,%s", modes[what], scales[scale], res);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  if(meas_shadow_has(hp34401a_shadow[unit], buf, strcspn(buf, " "))) return 0;
+  /* CONF resets the range, resolution and trigger settings */
+  meas_shadow_invalidate(hp34401a_shadow[unit]);
+  return set(unit, buf);
 }
 
 /*
@@ -235,7 +283,7 @@ EXPORT int meas_hp34401a_set_resolution(int unit, int what, int scale, double re
 
 EXPORT int meas_hp34401a_set_integration_time(int unit, int what, int it) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1) 
     meas_err("meas_hp34401a_set_integration_time: Non-existent unit.");
@@ -244,8 +292,7 @@ EXPORT int meas_hp34401a_set_integration_time(int unit, int what, int it) {
   if(it < MEAS_HP34401A_INTEGRATION_TIME_20MNLPC || it > MEAS_HP34401A_INTEGRATION_TIME_100NLPC) 
     meas_err("meas_hp34401a_set_integration_time: Unknown time integration mode.");
   sprintf(buf, "%s %s", itime[what], itime_opts[it]);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -258,7 +305,7 @@ EXPORT int meas_hp34401a_set_integration_time(int unit, int what, int it) {
 
 EXPORT int meas_hp34401a_autozero(int unit, int setting) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1) 
     meas_err("meas_hp34401a_autozero: Non-existent unit.");
@@ -266,17 +313,16 @@ EXPORT int meas_hp34401a_autozero(int unit, int setting) {
   case MEAS_HP34401A_AUTOZERO_OFF:
     sprintf(buf, "SENS:ZERO:AUTO OFF");
     break;
-  case MEAS_HP34401A_AUTOZERO_ONCE:
-    sprintf(buf, "SENS:ZERO:AUTO ONCE");
-    break;
+  case MEAS_HP34401A_AUTOZERO_ONCE: /* zeroes now and then turns auto-zero off */
+    meas_shadow_forget(hp34401a_shadow[unit], "SENS:ZERO:AUTO", 14);
+    return meas_transport_write(hp34401a_fd[unit], "SENS:ZERO:AUTO ONCE");
   case MEAS_HP34401A_AUTOZERO_ON:
     sprintf(buf, "SENS:ZERO:AUTO ON");
     break;
   default:
     meas_err("meas_hp34401a_autozero: Unknown autozero setting.");
   }
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -295,15 +341,14 @@ EXPORT int meas_hp34401a_autozero(int unit, int setting) {
 
 EXPORT int meas_hp34401a_set_mode(int unit, int what) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_set_mode: Non-existent unit.");
   if(what < MEAS_HP34401A_MODE_VOLT_AC || what > MEAS_HP34401A_MODE_FREQUENCY)
     meas_err("meas_hp34401a_set_mode: Invalid mode.");
   sprintf(buf, "%s", setmodes[what]);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -319,20 +364,50 @@ EXPORT int meas_hp34401a_initiate_read(int unit) {
   
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_initiate_read: Non-existent unit.");
-  meas_gpib_write(hp34401a_fd[unit], "READ?", MEAS_HP34401A_CRLF);
+  meas_transport_write(hp34401a_fd[unit], "READ?");
   return 0;
 }
 
 EXPORT double meas_hp34401a_complete_read(int unit) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_complete_read: Non-existent unit.");
-  meas_gpib_read(hp34401a_fd[unit], buf);
+  meas_transport_read(hp34401a_fd[unit], buf, sizeof(buf));
   return atof(buf);
 }
 
+#ifdef GPIB
+/*
+ * Request service when a reading is available, so that many instruments
+ * can be serviced with meas_gpib_srq_wait() instead of blocking in
+ * meas_hp34401a_complete_read():
+ *
+ *   meas_hp34401a_srq(unit, handler, arg);
+ *   meas_hp34401a_initiate_read(unit);
+ *   ...
+ *   meas_gpib_srq_wait(board, -1.0);   -> handler(fd, status_byte, arg)
+ *
+ * The handler then gets the value (without waiting) with
+ * meas_hp34401a_complete_read().
+ *
+ * unit    = Unit number.
+ * handler = Service request handler (NULL = disable).
+ * arg     = Passed to the handler.
+ *
+ */
+
+EXPORT int meas_hp34401a_srq(int unit, void (*handler)(int, int, void *), void *arg) {
+
+  if(hp34401a_fd[unit] == -1)
+    meas_err("meas_hp34401a_srq: Non-existent unit.");
+  if(meas_transport_type(hp34401a_fd[unit]) != MEAS_TRANSPORT_GPIB)
+    meas_err("meas_hp34401a_srq: Only on GPIB.");
+  return meas_gpib_srq_enable(meas_transport_fd(hp34401a_fd[unit]), MEAS_GPIB_STB_MAV, 0, MEAS_HP34401A_CRLF, handler, arg);
+}
+#endif
+
 /*
  * Read sample from the instrument. The instrument predetermines the best settings.
  * The previous settings may be changed.
@@ -341,12 +416,13 @@ EXPORT double meas_hp34401a_complete_read(int unit) {
 
 EXPORT double meas_hp34401a_read_auto(int unit) {
   
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1) 
     meas_err("meas_hp34401a_read_auto: Non-existent unit.");
-  meas_gpib_write(hp34401a_fd[unit], "MEAS?", MEAS_HP34401A_CRLF);
-  meas_gpib_read(hp34401a_fd[unit], buf);
+  meas_transport_write(hp34401a_fd[unit], "MEAS?");
+  meas_shadow_invalidate(hp34401a_shadow[unit]);  /* MEAS? reconfigures the instrument */
+  meas_transport_read(hp34401a_fd[unit], buf, sizeof(buf));
   return atof(buf);
 }
 
@@ -362,17 +438,69 @@ EXPORT double meas_hp34401a_read_auto(int unit) {
 
 EXPORT int meas_hp34401a_set_trigger_source(int unit, int source){
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_set_trigger_source: Non-existent unit.");
   if(source < MEAS_HP34401A_TRIGGER_BUS || source > MEAS_HP34401A_TRIGGER_EXTERNAL)
     meas_err("meas_hp34401a_set_trigger_source: Invalid trigger source.");
   sprintf(buf, "TRIG:SOUR %s", trigger_sources[source]);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);  
+  return set(unit, buf);
+}
+
+/*
+ * Arm the instrument: it takes a reading at the next trigger (see
+ * meas_hp34401a_set_trigger_source()); collect it with meas_hp34401a_fetch().
+ * With MEAS_HP34401A_TRIGGER_BUS, several instruments can be triggered
+ * at the same moment with meas_gpib_trigger().
+ *
+ */
+
+EXPORT int meas_hp34401a_arm(int unit) {
+
+  if(hp34401a_fd[unit] == -1)
+    meas_err("meas_hp34401a_arm: Non-existent unit.");
+  return meas_transport_write(hp34401a_fd[unit], "INIT");
+}
+
+/*
+ * Collect the reading taken after meas_hp34401a_arm() (waits for the
+ * trigger if it has not come yet).
+ *
+ * unit = Unit number.
+ * val  = The reading.
+ *
+ * Returns zero on success or -1 on error.
+ *
+ */
+
+EXPORT int meas_hp34401a_fetch(int unit, double *val) {
+
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
+
+  if(hp34401a_fd[unit] == -1)
+    meas_err("meas_hp34401a_fetch: Non-existent unit.");
+  if(meas_transport_write(hp34401a_fd[unit], "FETC?") < 0 || meas_transport_read(hp34401a_fd[unit], buf, sizeof(buf)) < 0)
+    return -1;
+  *val = atof(buf);
   return 0;
 }
 
+/*
+ * Return the GPIB descriptor of the instrument (for meas_gpib_trigger()
+ * and the transaction engine).
+ *
+ */
+
+EXPORT int meas_hp34401a_fd(int unit) {
+
+  if(hp34401a_fd[unit] == -1)
+    meas_err("meas_hp34401a_fd: Non-existent unit.");
+  if(meas_transport_type(hp34401a_fd[unit]) != MEAS_TRANSPORT_GPIB)
+    meas_err("meas_hp34401a_fd: Not on GPIB.");
+  return meas_transport_fd(hp34401a_fd[unit]);
+}
+
 /*
  * Set trigger delay.
  *
@@ -383,20 +511,20 @@ EXPORT int meas_hp34401a_set_trigger_source(int unit, int source){
 
 EXPORT int meas_hp34401a_set_trigger_delay(int unit, double delay){
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1) 
     meas_err("meas_hp34401a_set_trigger_delay: Non-existent unit.");
   if(delay == MEAS_HP34401A_TRIGGER_AUTO) {
-    meas_gpib_write(hp34401a_fd[unit], "TRIG:DEL:AUTO ON", MEAS_HP34401A_CRLF);   
-    return 0;
+    meas_shadow_forget(hp34401a_shadow[unit], "TRIG:DEL", 8);
+    return set(unit, "TRIG:DEL:AUTO ON");
   }
   if(delay < 0.0 || delay > 3600.0)
     meas_err("meas_hp34401a_set_trigger_delay: Invalid trigger delay.");
   /* setting a delay manually disables automatic trigger delay */
-  sprintf(buf, "TRIG:DEL:%le", delay);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);  
-  return 0;
+  sprintf(buf, "TRIG:DEL %le", delay);
+  meas_shadow_forget(hp34401a_shadow[unit], "TRIG:DEL:AUTO", 13);
+  return set(unit, buf);
 }
 
 /*
@@ -408,15 +536,14 @@ EXPORT int meas_hp34401a_set_trigger_delay(int unit, double delay){
 
 EXPORT int meas_hp34401a_set_trigger_sample_count(int unit, int count) {
   
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1)
     meas_err("meas_hp34401a_set_trigger_sample_count: Non-existent unit.");
   if(count < 0 || count > 50000) 
     meas_err("meas_hp34401a_set_trigger_sample_count: Invalid count for triggering.");
   sprintf(buf, "SAMP:COUNT %d", count);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);  
-  return 0;
+  return set(unit, buf);
 }
 
 /*
@@ -428,15 +555,127 @@ EXPORT int meas_hp34401a_set_trigger_sample_count(int unit, int count) {
 
 EXPORT int meas_hp34401a_set_trigger_count(int unit, int count) {
   
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[MEAS_TRANSPORT_BUF_SIZE];
 
   if(hp34401a_fd[unit] == -1) 
     meas_err("meas_hp34401a_set_trigger_count: Non-existent unit.");
   if(count < 0 || count > 50000)
     meas_err("meas_hp34401a_set_trigger_count: Invalid count for triggering.");
   sprintf(buf, "TRIG:COUNT %d", count);
-  meas_gpib_write(hp34401a_fd[unit], buf, MEAS_HP34401A_CRLF);  
+  return set(unit, buf);
+}
+
+/* Exactly representable powers of ten */
+static double pow10_tab[] = {1E0, 1E1, 1E2, 1E3, 1E4, 1E5, 1E6, 1E7, 1E8, 1E9, 1E10, 1E11,
+			     1E12, 1E13, 1E14, 1E15, 1E16, 1E17, 1E18, 1E19, 1E20, 1E21, 1E22};
+
+/*
+ * Parse one reading (e.g. "-1.23456789E-03") at *p and advance *p past it.
+ * The mantissa is collected as an integer and scaled by an exact power of ten,
+ * which is exact for the instrument's 10 significant digits; anything else
+ * (e.g. the overload value 9.9E37) is left to strtod().
+ *
+ * Returns zero on success.
+ *
+ */
+
+static int parse_reading(char **p, double *val) {
+
+  char *s = *p, *end;
+  unsigned long long mant = 0;
+  int neg = 0, ndig = 0, scale = 0, exp = 0, eneg = 0;
+
+  if(*s == '+' || *s == '-') neg = (*s++ == '-');
+  for ( ; *s >= '0' && *s <= '9'; s++, ndig++)
+    mant = 10 * mant + (*s - '0');
+  if(*s == '.')
+    for (s++; *s >= '0' && *s <= '9'; s++, ndig++, scale--)
+      mant = 10 * mant + (*s - '0');
+  if(!ndig) return -1;
+  if(*s == 'E' || *s == 'e') {
+    s++;
+    if(*s == '+' || *s == '-') eneg = (*s++ == '-');
+    if(*s < '0' || *s > '9') return -1;
+    for ( ; *s >= '0' && *s <= '9'; s++)
+      if(exp < 1000) exp = 10 * exp + (*s - '0');
+  }
+  scale += eneg ? -exp : exp;
+  if(ndig > 18 || scale > 22 || scale < -22) {
+    *val = strtod(*p, &end);
+    if(end != s) return -1;
+  } else if(scale < 0) *val = (double) mant / pow10_tab[-scale];
+  else *val = (double) mant * pow10_tab[scale];
+  if(neg) *val = -*val;
+  *p = s;
   return 0;
 }
 
-#endif /* GPIB */
+/*
+ * Collect all readings taken after meas_hp34401a_arm() with one FETC?
+ * (waits for the measurement to complete). The transport timeout must
+ * cover the whole acquisition.
+ *
+ * unit = Unit number.
+ * vals = Array for the readings.
+ * max  = Size of vals.
+ *
+ * Returns the number of readings or -1 on error.
+ *
+ */
+
+EXPORT int meas_hp34401a_fetch_all(int unit, double *vals, int max) {
+
+  char buf[MEAS_HP34401A_BURST_MAX * MEAS_HP34401A_READING_LEN + 16], *p;
+  int n;
+
+  if(hp34401a_fd[unit] == -1)
+    meas_err("meas_hp34401a_fetch_all: Non-existent unit.");
+  meas_misc_disable_signals();
+  if(meas_transport_write(hp34401a_fd[unit], "FETC?") < 0 || meas_transport_read(hp34401a_fd[unit], buf, sizeof(buf)) < 0) {
+    meas_misc_enable_signals();
+    return -1;
+  }
+  meas_misc_enable_signals();
+  for (n = 0, p = buf; *p && n < max; n++) {
+    if(parse_reading(&p, &vals[n]) < 0) meas_err("meas_hp34401a_fetch_all: Malformed reading.");
+    if(*p == ',') p++;
+    else if(*p) meas_err("meas_hp34401a_fetch_all: Malformed reading list.");
+  }
+  if(*p) meas_err("meas_hp34401a_fetch_all: Too many readings.");
+  return n;
+}
+
+/*
+ * Burst acquisition: take samples readings on each of triggers triggers
+ * into the reading memory (SAMP:COUNT, TRIG:COUNT, INIT) and transfer them
+ * all with one FETC? (see meas_hp34401a_fetch_all()). The current function,
+ * range and trigger settings are used. The transport timeout is extended
+ * by MEAS_HP34401A_READING_TIME per reading for the FETC? (the timeout
+ * itself must cover the wait for the triggers).
+ *
+ * unit     = Unit number.
+ * samples  = Readings per trigger.
+ * triggers = Number of triggers.
+ * vals     = Array for the readings (samples * triggers).
+ *
+ * Returns the number of readings or -1 on error.
+ *
+ */
+
+EXPORT int meas_hp34401a_burst(int unit, int samples, int triggers, double *vals) {
+
+  int t = hp34401a_fd[unit], n;
+  double tmo;
+
+  if(t == -1)
+    meas_err("meas_hp34401a_burst: Non-existent unit.");
+  if(samples < 1 || triggers < 1 || samples * triggers > MEAS_HP34401A_BURST_MAX)
+    meas_err("meas_hp34401a_burst: Too many readings for the reading memory.");
+  if(meas_hp34401a_set_trigger_sample_count(unit, samples) < 0 || meas_hp34401a_set_trigger_count(unit, triggers) < 0 || meas_hp34401a_arm(unit) < 0)
+    return -1;
+  meas_transport_get_timeout(t, &tmo);
+  if(tmo > 0.0 && meas_transport_timeout(t, tmo + samples * triggers * MEAS_HP34401A_READING_TIME) < 0) return -1;
+  n = meas_hp34401a_fetch_all(unit, vals, samples * triggers);
+  if(tmo > 0.0) meas_transport_timeout(t, tmo);
+  return n;
+}
@@ -81,3 +81,12 @@
 
 /* trigger delay */
 #define MEAS_HP34401A_TRIGGER_AUTO (-1.0)
+
+/* Reading memory size (burst mode) */
+#define MEAS_HP34401A_BURST_MAX 512
+
+/* Time allowed per reading of a burst (s; 10 NPLC at 50 Hz with auto-zero) */
+#define MEAS_HP34401A_READING_TIME 0.4
+
+/* Space for one reading in a FETC? reply ("-1.23456789E-03,") */
+#define MEAS_HP34401A_READING_LEN 16
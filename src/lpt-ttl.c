@@ -23,17 +23,29 @@ static int fds[5] = {-1, -1, -1, -1, -1};
 #ifdef MEAS_LPT_DIRECTIO
 
 static unsigned ports[] = {0x378, 0x278}; /* lpt1 and lpt2 */
+static int perm[] = {0, 0};                /* I/O port access granted */
 
 /*
- * Initialize LPT.
+ * Initialize LPT. Gets I/O port access (requires root) once so that
+ * read/write/strobe below do not need any privileges.
  *
- * unit = Unit number to be initialized (not used at the moment).
+ * unit = Unit to be initialized (MEAS_LPT_LPT1 or MEAS_LPT_LPT2).
  *
  */
 
 EXPORT int meas_lpt_open(int unit) {
 
+  int rv;
+
+  if(unit < MEAS_LPT_LPT1 || unit > MEAS_LPT_LPT2)
+    meas_err("meas_lpt_open: Invalid parallel port.\n");
+  if(perm[unit]) return 0;
   /* could add here detection for parallel port presence */
+  meas_misc_root_on();
+  rv = ioperm(ports[unit], 3, 1);
+  meas_misc_root_off();
+  if(rv < 0) meas_err("meas_lpt_open: Can't get I/O port access.\n");
+  perm[unit] = 1;
   return 0;
 }
 
@@ -48,16 +60,10 @@ EXPORT int meas_lpt_open(int unit) {
 
 EXPORT int meas_lpt_read(int unit) {
 
-  unsigned char a;
-
   if(unit < MEAS_LPT_LPT1 || unit > MEAS_LPT_LPT2)
     meas_err("meas_lpt: Invalid parallel port.\n");
-  meas_misc_root_on();
-  ioperm(ports[unit], 3, 1);
-  a = inb(ports[unit]);
-  ioperm(ports[unit], 3, 0);
-  meas_misc_root_off();
-  return (int) a;
+  if(!perm[unit] && meas_lpt_open(unit) < 0) return -1;
+  return (int) inb(ports[unit]);
 }
 
 /*
@@ -72,12 +78,9 @@ EXPORT int meas_lpt_write(int unit, unsigned char a) {
 
   if(unit < MEAS_LPT_LPT1 || unit > MEAS_LPT_LPT2)
     meas_err("meas_lpt_write: Invalid parallel port.\n");
-  meas_misc_root_on();
-  ioperm(ports[unit], 3, 1);
+  if(!perm[unit] && meas_lpt_open(unit) < 0) return -1;
   /* setup data */
   outb(a, ports[unit]);
-  ioperm(ports[unit], 3, 0);
-  meas_misc_root_off();
   return 0;
 }
 
@@ -91,12 +94,11 @@ EXPORT int meas_lpt_write(int unit, unsigned char a) {
 
 EXPORT int meas_lpt_strobe(int unit, unsigned char value) {
 
-  meas_misc_root_on();
-  ioperm(ports[unit], 3, 1);
+  if(unit < MEAS_LPT_LPT1 || unit > MEAS_LPT_LPT2)
+    meas_err("meas_lpt_strobe: Invalid parallel port.\n");
+  if(!perm[unit] && meas_lpt_open(unit) < 0) return -1;
   /* strobe */
   outb(value?1:0, ports[unit]+2);
-  ioperm(ports[unit], 3, 0);
-  meas_misc_root_off();
   return 0;
 }
 
@@ -109,6 +111,11 @@ EXPORT int meas_lpt_strobe(int unit, unsigned char value) {
 
 EXPORT int meas_lpt_close(int unit) {
 
+  if(unit < MEAS_LPT_LPT1 || unit > MEAS_LPT_LPT2 || !perm[unit]) return 0;
+  meas_misc_root_on();
+  ioperm(ports[unit], 3, 0);
+  meas_misc_root_off();
+  perm[unit] = 0;
   return 0;
 }
 #else
@@ -128,12 +135,13 @@ EXPORT int meas_lpt_init(int unit) {
   if(fds[unit] == -1) {
     sprintf(buf, "/dev/parport%d", unit);
     meas_misc_root_on();
-    if((fds[unit] = open(buf, O_RDWR)) == -1)
+    fds[unit] = open(buf, O_RDWR);
+    meas_misc_root_off();
+    if(fds[unit] == -1)
       meas_err("meas_lpt_init: Non-existent parallel port.");
     ioctl(fds[unit], PPCLAIM, NULL);
     ioctl(fds[unit], PPEXCL, NULL);
     ioctl(fds[unit], PPSETMODE, &mode);
-    meas_misc_root_off();
   }
   return 0;
 }
@@ -170,9 +178,7 @@ EXPORT int meas_lpt_read(int unit) {
 
   if(fds[unit] == -1)
     meas_err("meas_lpt_read: Non-existent parallel port.");
-  meas_misc_root_on();
   ioctl(fds[unit], PPRDATA, &a);
-  meas_misc_root_off();
   return (int) a;
 }
 
@@ -192,9 +198,7 @@ EXPORT int meas_lpt_write(int unit, unsigned char a) {
 
   if(fds[unit] == -1)
     meas_err("meas_lpt_write: Non-existent parallel port.");
-  meas_misc_root_on();
   ioctl(fds[unit], PPWDATA, &a);
-  meas_misc_root_off();
   return 0;
 }
 
@@ -214,12 +218,10 @@ EXPORT int meas_lpt_strobe(int unit, unsigned char value) {
 
   if(fds[unit] == -1)
     meas_err("meas_lpt_strobe: Non-existent parallel port.");
-  meas_misc_root_on();
   /* Strobe */
   frob.mask = PARPORT_CONTROL_STROBE;
   frob.val = value?PARPORT_CONTROL_STROBE:0;
   ioctl(fds[unit], PPFCONTROL, &frob);
-  meas_misc_root_off();
   return 0;
 }
 
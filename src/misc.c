@@ -14,28 +14,47 @@
 
 static uid_t real_uid, effective_uid;
 static int been_here_root = 0;
+static int root_state = -1;           /* -1 = unknown, 0 = privileges off, 1 = on */
+static long root_transitions = 0;     /* number of seteuid() calls made */
 static struct timeval reference = {0, 0};
 
-/* Enable root privs - requires setuid root */
-EXPORT void meas_misc_root_on() {
+/*
+ * Privilege model: root privileges (setuid root executable) are only needed
+ * to open devices (and to get I/O port permissions). Drivers switch them on
+ * in their open functions and off before returning; the data paths operate
+ * on the already opened file descriptors and do not touch privileges.
+ *
+ */
+
+static void root_set(int on) {
 
   if(!been_here_root) {
     real_uid = getuid();
     effective_uid = geteuid();
     been_here_root = 1;
   }
-  seteuid(effective_uid);
+  if(root_state == on) return;
+  seteuid(on?effective_uid:real_uid);
+  root_state = on;
+  root_transitions++;
+}
+
+/* Enable root privs - requires setuid root */
+EXPORT void meas_misc_root_on() {
+
+  root_set(1);
 }
 
 /* Disable root privs */
 EXPORT void meas_misc_root_off() {
 
-  if(!been_here_root) {
-    real_uid = getuid();
-    effective_uid = geteuid();
-    been_here_root = 1;
-  }
-  seteuid(real_uid);
+  root_set(0);
+}
+
+/* Number of privilege transitions (seteuid() calls) so far */
+EXPORT long meas_misc_root_transitions() {
+
+  return root_transitions;
 }
 
 /* nanosecond resolution sleep function */
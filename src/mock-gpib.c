@@ -0,0 +1,717 @@
+/*
+ * Simulated GPIB instruments.
+ *
+ * When libmeas is built with GPIB=MOCK (see make.conf), gpib.c is compiled
+ * against mock-gpib/gpib/ib.h and the ib* calls end up here instead of in
+ * linux-gpib. Drivers can then be run (and their overhead measured)
+ * without a GPIB board or instruments.
+ *
+ * Instrument behaviour is scripted per GPIB address: each rule gives the
+ * reply to messages that begin with a given command, and how long the
+ * instrument takes to produce it. Messages that match no rule are accepted
+ * and ignored. A GET (group execute trigger, or ibtrg()) is handled as the
+ * message "*TRG".
+ *
+ * Script file (loaded with meas_mock_gpib_load(), or automatically from the
+ * file named by the environment variable MEAS_MOCK_GPIB):
+ *
+ *   # address  command  delay(s)  reply
+ *   22  READ?               0.020  +1.23456789E+00\n
+ *   8   PHAS?               0      12.5\n
+ *   1   CURVE?              0.001  :CURVE <block:5000>\n
+ *   3   ":MEASURE:FREQ? 10MHz,10Hz,(@1)"  0.1  +1.000000000E+06\n
+ *   rate 1000000
+ *
+ * The command is quoted if it contains spaces. The reply may contain the
+ * escapes \r, \n, \t, \\ and \xHH, and <block:N>, which expands to an IEEE
+ * 488.2 definite length block (#<digits><N><N data bytes>). Address -1
+ * matches every device. "rate" sets the simulated bus speed in bytes per
+ * second (0 = infinitely fast, the default).
+ *
+ * Service requests: a device that has been sent "*SRE n" with the MAV bit
+ * (16) set requests service when its reply is ready.
+ *
+ */
+
+#ifdef MEAS_MOCK_GPIB
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <gpib/ib.h>
+#include "mock-gpib.h"
+#include "misc.h"
+
+/* Board descriptors are the board numbers, device descriptors start here (as in linux-gpib) */
+#define FIRST_UD 16
+
+volatile int ibsta, iberr, ibcnt;
+volatile long ibcntl;
+
+/* Status of the calling thread's last call (ThreadIbsta() etc., as in linux-gpib) */
+static __thread int thread_sta, thread_err, thread_cnt;
+static __thread long thread_cntl;
+
+struct rule {
+  int pad;                  /* GPIB address (-1 = any) */
+  char *cmd;                /* message prefix */
+  int cmdlen;
+  double delay;             /* time to produce the reply (s) */
+  char *reply;
+  int len;
+};
+
+struct mdev {
+  int used;
+  int board;
+  int pad;
+  int tmo;                  /* ibtmo() value */
+  int eos;                  /* ibeos() value (character + flags) */
+  int eot;                  /* send EOI with the last byte */
+  char in[MEAS_MOCK_GPIB_MSGLEN];  /* message being received */
+  int inlen;
+  struct rule *reply;       /* pending reply (NULL = none) */
+  int outpos;               /* bytes of it already read */
+  struct timespec ready;    /* when the reply is available */
+  int sre;                  /* service request enable mask */
+  int polled;               /* serial polled since the reply became ready */
+  char *abuf;               /* async read in progress (ibrda) */
+  long acount;
+  int apending;
+  struct timespec adone;    /* completion time of the async read */
+};
+
+static struct rule rules[MEAS_MOCK_GPIB_MAXRULES];
+static int nrules = 0;
+static struct mdev mdevs[MEAS_MOCK_GPIB_MAXDEVS];
+static int board_tmo[FIRST_UD];
+static double rate = 0.0;
+static long messages[32];   /* messages received per address */
+static int loaded = 0;
+static int listeners[32];   /* addressed to listen (ibcmd()) */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double tmo_sec[] = {0.0, 10E-6, 30E-6, 100E-6, 300E-6, 1E-3, 3E-3, 10E-3, 30E-3,
+			   0.1, 0.3, 1.0, 3.0, 10.0, 30.0, 100.0, 300.0, 1000.0};
+
+static void ts_add(struct timespec *ts, double sec) {
+
+  ts->tv_sec += (time_t) sec;
+  ts->tv_nsec += (long) (1E9 * (sec - (double) (time_t) sec));
+  if(ts->tv_nsec >= 1000000000L) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+/* Seconds from now until ts (negative if passed) */
+static double ts_left(struct timespec *ts) {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) (ts->tv_sec - now.tv_sec) + 1E-9 * (double) (ts->tv_nsec - now.tv_nsec);
+}
+
+static void delay(double sec) {
+
+  if(sec > 0.0) meas_misc_nsleep((time_t) sec, (long) (1E9 * (sec - (double) (time_t) sec)));
+}
+
+/* Timeout of a device in seconds (0 = none) */
+static double timeout(int tmo) {
+
+  if(tmo < 0 || tmo > T1000s) tmo = T10s;
+  return tmo_sec[tmo];
+}
+
+static struct mdev *mdev_find(int ud) {
+
+  if(ud < FIRST_UD || ud >= FIRST_UD + MEAS_MOCK_GPIB_MAXDEVS || !mdevs[ud - FIRST_UD].used) return NULL;
+  return &mdevs[ud - FIRST_UD];
+}
+
+static int status(int sta, int err, long cnt) {
+
+  if(sta & ERR) iberr = thread_err = err;
+  ibcnt = thread_cnt = (int) cnt;
+  ibcntl = thread_cntl = cnt;
+  return ibsta = thread_sta = sta;
+}
+
+/* Parse reply with escapes and <block:N>. Returns length or -1. */
+static int parse_reply(char *src, char **dst) {
+
+  int len = 0, size = 256, n, i;
+  char *out, digits[16];
+
+  if(!(out = (char *) malloc(size))) return -1;
+  while(*src) {
+    n = 1;
+    if(!strncmp(src, "<block:", 7)) n = atoi(src + 7) + 16;
+    if(len + n >= size) {
+      size = 2 * (len + n);
+      if(!(out = (char *) realloc(out, size))) return -1;
+    }
+    if(!strncmp(src, "<block:", 7)) {
+      n = atoi(src + 7);
+      sprintf(digits, "%d", n);
+      len += sprintf(out + len, "#%d%s", (int) strlen(digits), digits);
+      for(i = 0; i < n; i++)
+	out[len++] = (char) i;
+      if(!(src = strchr(src, '>'))) break;
+      src++;
+      continue;
+    }
+    if(*src == '\\' && src[1]) {
+      src++;
+      switch(*src) {
+      case 'r': out[len++] = '\r'; break;
+      case 'n': out[len++] = '\n'; break;
+      case 't': out[len++] = '\t'; break;
+      case 'x': out[len++] = (char) strtol(src + 1, &src, 16); continue;
+      default: out[len++] = *src;
+      }
+      src++;
+      continue;
+    }
+    out[len++] = *src++;
+  }
+  *dst = out;
+  return len;
+}
+
+/*
+ * Add a scripted reply.
+ *
+ * pad   = GPIB address of the instrument (-1 = any).
+ * cmd   = The rule applies to messages beginning with this.
+ * delay = Time the instrument takes to produce the reply (s).
+ * reply = Reply (binary data allowed).
+ * len   = Reply length.
+ *
+ */
+
+EXPORT int meas_mock_gpib_rule(int pad, char *cmd, double delay, char *reply, int len) {
+
+  struct rule *r;
+
+  pthread_mutex_lock(&lock);
+  if(nrules == MEAS_MOCK_GPIB_MAXRULES) {
+    pthread_mutex_unlock(&lock);
+    meas_err("meas_mock_gpib_rule: Too many rules.");
+  }
+  r = &rules[nrules];
+  if(!(r->cmd = strdup(cmd)) || !(r->reply = (char *) malloc(len + 1))) {
+    pthread_mutex_unlock(&lock);
+    meas_err("meas_mock_gpib_rule: Out of memory.");
+  }
+  memcpy(r->reply, reply, len);
+  r->pad = pad;
+  r->cmdlen = strlen(cmd);
+  r->delay = delay;
+  r->len = len;
+  nrules++;
+  pthread_mutex_unlock(&lock);
+  return 0;
+}
+
+/*
+ * Set simulated bus speed.
+ *
+ * bytes_per_sec = Transfer rate (0 = infinitely fast).
+ *
+ */
+
+EXPORT int meas_mock_gpib_rate(double bytes_per_sec) {
+
+  rate = bytes_per_sec;
+  return 0;
+}
+
+/*
+ * Number of messages an instrument has received (including GETs).
+ *
+ * pad = GPIB address.
+ *
+ */
+
+EXPORT long meas_mock_gpib_messages(int pad) {
+
+  if(pad < 0 || pad > 30) meas_err("meas_mock_gpib_messages: Illegal address.");
+  return messages[pad];
+}
+
+/*
+ * Load a script (see the beginning of this file).
+ *
+ * file = Script file name.
+ *
+ */
+
+EXPORT int meas_mock_gpib_load(char *file) {
+
+  FILE *fp;
+  char line[MEAS_MOCK_GPIB_MSGLEN], *p, *cmd, *reply;
+  int pad, len, lineno = 0;
+  double dly;
+
+  if(!(fp = fopen(file, "r"))) meas_err("meas_mock_gpib_load: Can't open script.");
+  loaded = 1;
+  while(fgets(line, sizeof(line), fp)) {
+    lineno++;
+    if((p = strchr(line, '\n'))) *p = 0;
+    for(p = line; *p == ' ' || *p == '\t'; p++);
+    if(!*p || *p == '#') continue;
+    if(!strncmp(p, "rate", 4)) {
+      meas_mock_gpib_rate(atof(p + 4));
+      continue;
+    }
+    pad = (int) strtol(p, &p, 10);
+    for(; *p == ' ' || *p == '\t'; p++);
+    if(*p == '"') {
+      cmd = ++p;
+      if(!(p = strchr(p, '"'))) break;
+    } else {
+      cmd = p;
+      for(; *p && *p != ' ' && *p != '\t'; p++);
+    }
+    if(!*p) break;
+    *p++ = 0;
+    dly = strtod(p, &p);
+    for(; *p == ' ' || *p == '\t'; p++);
+    if((len = parse_reply(p, &reply)) < 0) break;
+    len = meas_mock_gpib_rule(pad, cmd, dly, reply, len);
+    free(reply);
+    if(len < 0) break;
+  }
+  if(!feof(fp)) {
+    fclose(fp);
+    fprintf(stderr, "meas_mock_gpib_load: %s line %d: syntax error.\n", file, lineno);
+    return -1;
+  }
+  fclose(fp);
+  return 0;
+}
+
+/* Message to the device complete (lock held) */
+static void message(struct mdev *d, char *msg, int len) {
+
+  int i;
+  struct rule *r;
+
+  while(len > 0 && (msg[len-1] == '\r' || msg[len-1] == '\n' || (d->eos & XEOS && msg[len-1] == (char) d->eos)))
+    len--;
+  messages[d->pad]++;
+  if(len >= 5 && !strncmp(msg, "*SRE ", 5)) d->sre = atoi(msg + 5);
+  for(i = 0; i < nrules; i++) {
+    r = &rules[i];
+    if((r->pad == -1 || r->pad == d->pad) && r->cmdlen <= len && !memcmp(r->cmd, msg, r->cmdlen)) {
+      d->reply = r;
+      d->outpos = 0;
+      d->polled = 0;
+      clock_gettime(CLOCK_MONOTONIC, &d->ready);
+      ts_add(&d->ready, r->delay);
+      return;
+    }
+  }
+}
+
+/* Move reply bytes to buf (lock held). Returns ibsta. */
+static int transfer(struct mdev *d, char *buf, long count) {
+
+  long n = 0;
+  char *reply = d->reply->reply;
+  int end = 0;
+
+  while(n < count && d->outpos < d->reply->len) {
+    buf[n] = reply[d->outpos++];
+    if((d->eos & REOS) && ((d->eos & BIN)?(buf[n] == (char) d->eos):((buf[n] & 0x7f) == (d->eos & 0x7f)))) {
+      n++;
+      end = 1;
+      break;
+    }
+    n++;
+  }
+  if(d->outpos == d->reply->len) {
+    d->reply = NULL;
+    end = 1;
+  }
+  return status(CMPL | (end?END:0), 0, n);
+}
+
+int ThreadIbsta(void) {
+
+  return thread_sta;
+}
+
+int ThreadIberr(void) {
+
+  return thread_err;
+}
+
+int ThreadIbcnt(void) {
+
+  return thread_cnt;
+}
+
+long ThreadIbcntl(void) {
+
+  return thread_cntl;
+}
+
+/* Load the script named in the environment (once) */
+static void autoload() {
+
+  char *file;
+
+  if(loaded) return;
+  loaded = 1;
+  if((file = getenv(MEAS_MOCK_GPIB_ENV))) meas_mock_gpib_load(file);
+}
+
+int ibfind(const char *dev) {
+
+  int board;
+
+  autoload();
+  if(strncmp(dev, "gpib", 4) || (board = atoi(dev + 4)) < 0 || board >= FIRST_UD) {
+    status(ERR, EDVR, 0);
+    return -1;
+  }
+  board_tmo[board] = T3s;
+  return board;
+}
+
+int ibdev(int board, int pad, int sad, int tmo, int eot, int eos) {
+
+  int i;
+
+  autoload();
+  if(pad < 0 || pad > 30) {
+    status(ERR, EARG, 0);
+    return -1;
+  }
+  pthread_mutex_lock(&lock);
+  for(i = 0; i < MEAS_MOCK_GPIB_MAXDEVS; i++)
+    if(!mdevs[i].used) break;
+  if(i == MEAS_MOCK_GPIB_MAXDEVS) {
+    pthread_mutex_unlock(&lock);
+    status(ERR, ETAB, 0);
+    return -1;
+  }
+  memset(&mdevs[i], 0, sizeof(struct mdev));
+  mdevs[i].used = 1;
+  mdevs[i].board = board;
+  mdevs[i].pad = pad;
+  mdevs[i].tmo = tmo;
+  mdevs[i].eot = eot;
+  mdevs[i].eos = eos;
+  pthread_mutex_unlock(&lock);
+  status(CMPL, 0, 0);
+  return FIRST_UD + i;
+}
+
+int ibonl(int ud, int online) {
+
+  struct mdev *d;
+
+  pthread_mutex_lock(&lock);
+  if((d = mdev_find(ud)) && !online) d->used = 0;
+  pthread_mutex_unlock(&lock);
+  return status(CMPL, 0, 0);
+}
+
+int ibtmo(int ud, int v) {
+
+  struct mdev *d;
+
+  if(v < TNONE || v > T1000s) return status(ERR, EARG, 0);
+  if((d = mdev_find(ud))) d->tmo = v;
+  else if(ud >= 0 && ud < FIRST_UD) board_tmo[ud] = v;
+  return status(CMPL, 0, 0);
+}
+
+int ibeos(int ud, int v) {
+
+  struct mdev *d;
+
+  if((d = mdev_find(ud))) d->eos = v;
+  return status(CMPL, 0, 0);
+}
+
+int ibeot(int ud, int v) {
+
+  struct mdev *d;
+
+  if((d = mdev_find(ud))) d->eot = v;
+  return status(CMPL, 0, 0);
+}
+
+int ibconfig(int ud, int option, int value) {
+
+  switch(option) {
+  case IbcTMO:
+    return ibtmo(ud, value);
+  case IbcEOT:
+    return ibeot(ud, value);
+  }
+  return status(CMPL, 0, 0);
+}
+
+int ibask(int ud, int option, int *value) {
+
+  struct mdev *d;
+
+  if(!(d = mdev_find(ud))) {
+    if(ud < 0 || ud >= FIRST_UD || option != IbcTMO) return status(ERR, EARG, 0);
+    *value = board_tmo[ud];
+    return status(CMPL, 0, 0);
+  }
+  switch(option) {
+  case IbcPAD: *value = d->pad; break;
+  case IbcTMO: *value = d->tmo; break;
+  case IbcEOT: *value = d->eot; break;
+  default: return status(ERR, EARG, 0);
+  }
+  return status(CMPL, 0, 0);
+}
+
+int ibwrt(int ud, const void *buf, long count) {
+
+  struct mdev *d;
+
+  pthread_mutex_lock(&lock);
+  if(!(d = mdev_find(ud))) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EDVR, 0);
+  }
+  if(d->inlen + count > MEAS_MOCK_GPIB_MSGLEN) d->inlen = 0;  /* too long: drop */
+  else {
+    memcpy(d->in + d->inlen, buf, count);
+    d->inlen += count;
+  }
+  if(d->eot) {
+    message(d, d->in, d->inlen);
+    d->inlen = 0;
+  }
+  pthread_mutex_unlock(&lock);
+  if(rate > 0.0) delay((double) count / rate);
+  return status(CMPL, 0, count);
+}
+
+/* Writes complete right away */
+int ibwrta(int ud, const void *buf, long count) {
+
+  return ibwrt(ud, buf, count);
+}
+
+int ibrd(int ud, void *buf, long count) {
+
+  struct mdev *d;
+  double left, tmo;
+  int sta;
+
+  pthread_mutex_lock(&lock);
+  if(!(d = mdev_find(ud))) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EDVR, 0);
+  }
+  tmo = timeout(d->tmo);
+  if(!d->reply) {
+    /* nothing to talk about: the instrument never responds */
+    pthread_mutex_unlock(&lock);
+    delay(tmo);
+    return status(ERR | TIMO, EABO, 0);
+  }
+  left = ts_left(&d->ready);
+  pthread_mutex_unlock(&lock);
+  if(tmo > 0.0 && left > tmo) {
+    delay(tmo);
+    return status(ERR | TIMO, EABO, 0);
+  }
+  delay(left);
+  pthread_mutex_lock(&lock);
+  if(!d->reply) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EABO, 0);
+  }
+  sta = transfer(d, (char *) buf, count);
+  pthread_mutex_unlock(&lock);
+  if(rate > 0.0) delay((double) thread_cnt / rate);
+  return sta;
+}
+
+int ibrda(int ud, void *buf, long count) {
+
+  struct mdev *d;
+  double tmo;
+
+  pthread_mutex_lock(&lock);
+  if(!(d = mdev_find(ud))) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EDVR, 0);
+  }
+  d->abuf = (char *) buf;
+  d->acount = count;
+  d->apending = 1;
+  clock_gettime(CLOCK_MONOTONIC, &d->adone);
+  tmo = timeout(d->tmo);
+  if(!d->reply) ts_add(&d->adone, tmo);
+  else if(tmo > 0.0 && ts_left(&d->ready) > tmo) ts_add(&d->adone, tmo);  /* times out */
+  else if(ts_left(&d->ready) > 0.0) d->adone = d->ready;
+  if(rate > 0.0 && d->reply) ts_add(&d->adone, (double) (d->reply->len - d->outpos) / rate);
+  pthread_mutex_unlock(&lock);
+  return status(0, 0, 0);
+}
+
+/* Complete async read if its time has come (lock held). Returns ibsta or 0 if not done yet. */
+static int acomplete(struct mdev *d) {
+
+  if(!d->apending) return status(CMPL, 0, thread_cnt);
+  if(ts_left(&d->adone) > 0.0) return 0;
+  d->apending = 0;
+  if(!d->reply) return status(CMPL | ERR | TIMO, EABO, 0);
+  if(ts_left(&d->ready) > 0.0) return status(CMPL | ERR | TIMO, EABO, 0);
+  return transfer(d, d->abuf, d->acount);
+}
+
+/* Is the device requesting service? (lock held) */
+static int requesting(struct mdev *d) {
+
+  return (d->sre & 0x10) && d->reply && !d->polled && ts_left(&d->ready) <= 0.0;
+}
+
+int ibwait(int ud, int mask) {
+
+  struct mdev *d;
+  struct timespec end;
+  double left, tmo;
+  int i, sta;
+
+  if(ud >= 0 && ud < FIRST_UD) {
+    /* board: wait for a service request */
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ts_add(&end, (tmo = timeout(board_tmo[ud])));
+    while(1) {
+      pthread_mutex_lock(&lock);
+      for(i = 0; i < MEAS_MOCK_GPIB_MAXDEVS; i++)
+	if(mdevs[i].used && mdevs[i].board == ud && requesting(&mdevs[i])) break;
+      pthread_mutex_unlock(&lock);
+      if(i < MEAS_MOCK_GPIB_MAXDEVS) return status(CMPL | SRQI, 0, 0);
+      if(!(mask & SRQI)) return status(CMPL, 0, 0);
+      if((mask & TIMO) && tmo > 0.0 && ts_left(&end) <= 0.0) return status(CMPL | TIMO, 0, 0);
+      delay(100E-6);
+    }
+  }
+  pthread_mutex_lock(&lock);
+  if(!(d = mdev_find(ud))) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EDVR, 0);
+  }
+  if(d->apending && (mask & (CMPL | TIMO))) {
+    left = ts_left(&d->adone);
+    pthread_mutex_unlock(&lock);
+    delay(left);
+    pthread_mutex_lock(&lock);
+  }
+  if(!(sta = acomplete(d))) sta = status(0, 0, 0);
+  if(requesting(d)) sta = status(sta | RQS, 0, thread_cnt);
+  pthread_mutex_unlock(&lock);
+  return sta;
+}
+
+int ibstop(int ud) {
+
+  struct mdev *d;
+
+  pthread_mutex_lock(&lock);
+  if((d = mdev_find(ud)) && d->apending) {
+    d->apending = 0;
+    pthread_mutex_unlock(&lock);
+    return status(CMPL | ERR, EABO, 0);
+  }
+  pthread_mutex_unlock(&lock);
+  return status(CMPL, 0, 0);
+}
+
+/* Bus commands: only listener addressing and GET are simulated */
+int ibcmd(int ud, const void *cmd, long count) {
+
+  const unsigned char *c = (const unsigned char *) cmd;
+  long i;
+  int j;
+
+  pthread_mutex_lock(&lock);
+  for(i = 0; i < count; i++) {
+    if(c[i] == UNL) memset(listeners, 0, sizeof(listeners));
+    else if(c[i] >= LAD && c[i] < LAD + 31) listeners[c[i] - LAD] = 1;
+    else if(c[i] == GET)
+      for(j = 0; j < MEAS_MOCK_GPIB_MAXDEVS; j++)
+	if(mdevs[j].used && mdevs[j].board == ud && listeners[mdevs[j].pad]) message(&mdevs[j], "*TRG", 4);
+  }
+  pthread_mutex_unlock(&lock);
+  return status(CMPL, 0, count);
+}
+
+int ibtrg(int ud) {
+
+  struct mdev *d;
+
+  pthread_mutex_lock(&lock);
+  if(!(d = mdev_find(ud))) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EDVR, 0);
+  }
+  message(d, "*TRG", 4);
+  pthread_mutex_unlock(&lock);
+  return status(CMPL, 0, 0);
+}
+
+int ibclr(int ud) {
+
+  struct mdev *d;
+
+  pthread_mutex_lock(&lock);
+  if((d = mdev_find(ud))) {
+    d->reply = NULL;
+    d->inlen = 0;
+    d->apending = 0;
+  }
+  pthread_mutex_unlock(&lock);
+  return status(CMPL, 0, 0);
+}
+
+int ibsic(int ud) {
+
+  return status(CMPL, 0, 0);
+}
+
+int ibsre(int ud, int v) {
+
+  return status(CMPL, 0, 0);
+}
+
+int ibrsp(int ud, char *spr) {
+
+  struct mdev *d;
+  int stb = 0;
+
+  pthread_mutex_lock(&lock);
+  if(!(d = mdev_find(ud))) {
+    pthread_mutex_unlock(&lock);
+    return status(ERR, EDVR, 0);
+  }
+  if(d->reply && ts_left(&d->ready) <= 0.0) stb |= 0x10;  /* MAV */
+  if(requesting(d)) {
+    stb |= 0x40;  /* RQS */
+    d->polled = 1;
+  }
+  pthread_mutex_unlock(&lock);
+  *spr = (char) stb;
+  return status(CMPL, 0, 0);
+}
+
+#endif /* MEAS_MOCK_GPIB */
@@ -0,0 +1,18 @@
+#ifdef MEAS_MOCK_GPIB
+/*
+ * Simulated GPIB instruments (GPIB=MOCK in make.conf).
+ *
+ */
+
+/* Maximum number of scripted replies */
+#define MEAS_MOCK_GPIB_MAXRULES 256
+
+/* Maximum number of open simulated devices */
+#define MEAS_MOCK_GPIB_MAXDEVS 64
+
+/* Maximum length of a message sent to a device */
+#define MEAS_MOCK_GPIB_MSGLEN 4096
+
+/* Script to load when the first device is opened */
+#define MEAS_MOCK_GPIB_ENV "MEAS_MOCK_GPIB"
+#endif
@@ -0,0 +1,116 @@
+/*
+ * Stand-in for the linux-gpib <gpib/ib.h> when libmeas is built with
+ * GPIB=MOCK (see make.conf). Only the parts of the API that libmeas uses
+ * are provided; they are implemented by simulated instruments in
+ * src/mock-gpib.c. Constant values are the same as in linux-gpib.
+ *
+ */
+
+#ifndef MEAS_MOCK_GPIB_IB_H
+#define MEAS_MOCK_GPIB_IB_H
+
+/* ibsta bits */
+#define DCAS  (1 << 0)
+#define DTAS  (1 << 1)
+#define LACS  (1 << 2)
+#define TACS  (1 << 3)
+#define ATN   (1 << 4)
+#define CIC   (1 << 5)
+#define REM   (1 << 6)
+#define LOK   (1 << 7)
+#define CMPL  (1 << 8)
+#define EVENT (1 << 9)
+#define SPOLL (1 << 10)
+#define RQS   (1 << 11)
+#define SRQI  (1 << 12)
+#define END   (1 << 13)
+#define TIMO  (1 << 14)
+#define ERR   (1 << 15)
+
+/* iberr values */
+#define EDVR 0
+#define ECIC 1
+#define ENOL 2
+#define EADR 3
+#define EARG 4
+#define ESAC 5
+#define EABO 6
+#define ENEB 7
+#define EDMA 8
+#define EOIP 10
+#define ECAP 11
+#define EFSO 12
+#define EBUS 14
+#define ESTB 15
+#define ESRQ 16
+#define ETAB 20
+
+/* ibeos() flags */
+#define REOS 0x400
+#define XEOS 0x800
+#define BIN  0x1000
+
+/* ibtmo() values */
+enum {
+  TNONE = 0, T10us, T30us, T100us, T300us, T1ms, T3ms, T10ms, T30ms,
+  T100ms, T300ms, T1s, T3s, T10s, T30s, T100s, T300s, T1000s
+};
+
+/* ibconfig() / ibask() options (subset) */
+#define IbcPAD      0x1
+#define IbcSAD      0x2
+#define IbcTMO      0x3
+#define IbcEOT      0x4
+#define IbcAUTOPOLL 0x7
+#define IbcEOSrd    0xc
+#define IbcEOSwrt   0xd
+#define IbcEOScmp   0xe
+#define IbcEOSchar  0xf
+#define IbaTMO      IbcTMO
+
+/* GPIB command bytes */
+#define GTL 0x01
+#define SDC 0x04
+#define PPC 0x05
+#define GET 0x08
+#define TCT 0x09
+#define LLO 0x11
+#define DCL 0x14
+#define PPU 0x15
+#define SPE 0x18
+#define SPD 0x19
+#define LAD 0x20
+#define UNL 0x3f
+#define TAD 0x40
+#define UNT 0x5f
+
+extern volatile int ibsta, iberr, ibcnt;
+extern volatile long ibcntl;
+
+extern int ThreadIbsta(void);
+extern int ThreadIberr(void);
+extern int ThreadIbcnt(void);
+extern long ThreadIbcntl(void);
+
+extern int ibfind(const char *dev);
+extern int ibdev(int board, int pad, int sad, int tmo, int eot, int eos);
+extern int ibonl(int ud, int online);
+extern int ibtmo(int ud, int v);
+extern int ibeos(int ud, int v);
+extern int ibeot(int ud, int v);
+extern int ibconfig(int ud, int option, int value);
+extern int ibask(int ud, int option, int *value);
+extern int ibwrt(int ud, const void *buf, long count);
+extern int ibwrta(int ud, const void *buf, long count);
+extern int ibrd(int ud, void *buf, long count);
+extern int ibrda(int ud, void *buf, long count);
+extern int ibwait(int ud, int mask);
+extern int ibstop(int ud);
+extern int ibcmd(int ud, const void *cmd, long count);
+extern int ibsic(int ud);
+extern int ibsre(int ud, int v);
+extern int ibclr(int ud);
+extern int ibtrg(int ud);
+extern int ibrsp(int ud, char *spr);
+
+#endif
@@ -200,7 +200,6 @@ EXPORT int meas_newport_is_read(int cd, double exp, int ext, int ave, double *ds
   unsigned char buf[2 * 1024];
   int i, j;
 
-  meas_misc_root_on();
   if(cd < 0 || cd >= MEAS_NEWPORT_IS_MAXDEV || !udevs[cd]) return -1;
 
   /* Prepare scan request */
@@ -251,7 +250,6 @@ EXPORT int meas_newport_is_read(int cd, double exp, int ext, int ave, double *ds
 
   for (i = 0; i < 1024; i++) dst[i] /= (double) ave;
 
-  meas_misc_root_off();
   return 0;
 }
 
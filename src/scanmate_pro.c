@@ -14,15 +14,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <signal.h>
 #include <string.h>
-#include <setjmp.h>
 #include "scanmate_pro.h"
 #include "serial.h"
 #include "misc.h"
 
-static sigjmp_buf env;
-
 static int dye_fd[5] = {-1, -1, -1, -1, -1};
 
 /*
@@ -61,11 +57,6 @@ EXPORT int meas_scanmate_pro_grating(int unit, int x) {
   return 0;
 }
 
-static void scanmate_pro_signal(int x) {
-
-  longjmp(env, 1); /* Activate the alarm handler code in scanmate_pro_setwl() */
-}
-
 /*
  * Set wavelength.
  *
@@ -77,35 +68,36 @@ static void scanmate_pro_signal(int x) {
 EXPORT int meas_scanmate_pro_setwl(int unit, double wl) {
 
   char buf[512];
-  int i;
+  int status;
+  struct timespec end, dl;
 
   if(dye_fd[unit] == -1) meas_err("meas_scanmate_pro_setwl: Illegal unit.");
 
   sprintf(buf, "X=%lf\r", wl);
   meas_rs232_write(dye_fd[unit], buf, strlen(buf)+1);
 
-  (void) signal(SIGALRM, scanmate_pro_signal);
-  alarm(MEAS_SCANMATE_PRO_SKIP_HANDSHAKE); /* Sometimes ack from the dyelaser is lost */
-                         /* Continue after some timeout (specified by MEAS_SCANMATE_PRO_SKIP_HANDSHAKE) */
-  if(setjmp(env)) {
-    alarm(0); /* cancel alarm */
-    signal(SIGALRM, SIG_DFL); /* clear signal handler */
-    fprintf(stderr, "meas_scanmate_pro_setwl: Lost dyelaser response.\n");
-    return 0; /* if returning from alarm interrupt, return */
-  }
-
+  /* Sometimes ack from the dyelaser is lost */
+  /* Continue after some timeout (specified by MEAS_SCANMATE_PRO_SKIP_HANDSHAKE) */
+  meas_rs232_deadline(&end, MEAS_SCANMATE_PRO_SKIP_HANDSHAKE);
   while(1) {
     meas_rs232_write(dye_fd[unit], "S?\r", 3);
-    meas_rs232_readnl(dye_fd[unit], buf);
-    if(buf[0] == 'R') {
-      alarm(0); /* cancel alarm */
-      signal(SIGALRM, SIG_DFL); /* clear signal handler */
-      break;
+    meas_rs232_deadline(&dl, MEAS_SCANMATE_PRO_REPLY_TIMEOUT);
+    if(meas_rs232_readeoc_dl(dye_fd[unit], buf, sizeof(buf), MEAS_SERIAL_EOS, &dl, &status) < 0) {
+      meas_rs232_flush(dye_fd[unit]);
+      return -1;
+    }
+    if(status == MEAS_RS232_OK && buf[0] == 'R') break;
+    if(meas_rs232_expired(&end)) {
+      fprintf(stderr, "meas_scanmate_pro_setwl: Lost dyelaser response.\n");
+      meas_rs232_flush(dye_fd[unit]);
+      return 0;
     }
-    meas_misc_nsleep(0, 20000000); /* sleep for 20 ms before recheck */
+    if(status == MEAS_RS232_OK)
+      meas_misc_nsleep(0, 20000000); /* sleep for 20 ms before recheck */
+    else meas_rs232_flush(dye_fd[unit]);  /* on timeout, drop any late reply and ask again right away */
   }
-  alarm(0);
   sleep(1); /* Just be sure that things have settled down */
+  meas_rs232_flush(dye_fd[unit]);  /* replies to earlier S? that came in late */
   return 0;
 }
 
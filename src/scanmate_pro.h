@@ -1,5 +1,8 @@
 /* Sometimes ack from the dye laser fails. Continue after 30s */
-#define MEAS_SCANMATE_PRO_SKIP_HANDSHAKE 30
+#define MEAS_SCANMATE_PRO_SKIP_HANDSHAKE 30.0
+
+/* Timeout for a single status query reply (s); the query is repeated after this */
+#define MEAS_SCANMATE_PRO_REPLY_TIMEOUT 0.5
 
 /* stepper motors */
 #define MEAS_SCANMATE_PRO_GRATING 1
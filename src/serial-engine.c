@@ -0,0 +1,305 @@
+/*
+ * Event driven RS232 transaction engine.
+ *
+ * Request/response transactions (command + reply terminated by a given
+ * string) are submitted to any number of ports and run concurrently using
+ * epoll. A sweep over several slow instruments then takes as long as the
+ * slowest one rather than the sum of all of them.
+ *
+ * Transactions to the same port are run in the order they were submitted.
+ *
+ * Typical use:
+ *
+ *   h1 = meas_rs232_engine_submit(fd1, "R1\r", 3, "\r", 1.0);
+ *   h2 = meas_rs232_engine_submit(fd2, "p", 1, "\r", 1.0);
+ *   while((h = meas_rs232_engine_next(-1.0)) >= 0) {
+ *     meas_rs232_engine_result(h, buf, &status);
+ *     ...
+ *   }
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include "serial.h"
+#include "serial-engine.h"
+#include "misc.h"
+
+/* Transaction states */
+#define XACT_FREE   0
+#define XACT_QUEUED 1  /* waiting for the port */
+#define XACT_ACTIVE 2  /* command sent, waiting for reply */
+#define XACT_DONE   3  /* completed or timed out, not yet collected */
+
+struct xact {
+  int state;
+  int fd;                                    /* RS232 port */
+  char cmd[MEAS_RS232_ENGINE_CMDLEN];        /* command to send */
+  int cmdlen;
+  char eot[MEAS_RS232_ENGINE_EOTLEN];        /* reply terminator */
+  double timeout;                            /* reply timeout (s) */
+  struct timespec dl;                        /* reply deadline (when active) */
+  char reply[MEAS_RS232_ENGINE_REPLYLEN];    /* reply */
+  int len;
+  int status;                                /* MEAS_RS232_OK, ... */
+  int reported;                              /* returned by meas_rs232_engine_next() */
+  unsigned long seq;                         /* submission order */
+};
+
+static struct xact xacts[MEAS_RS232_ENGINE_MAX];
+static int epfd = -1;
+static unsigned long seq = 0;
+
+/* Milliseconds until dl (rounded up; 0 if passed) */
+static int ms_left(struct timespec *dl) {
+
+  struct timespec now;
+  long long ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (long long) (dl->tv_sec - now.tv_sec) * 1000000000LL + (dl->tv_nsec - now.tv_nsec);
+  if(ns <= 0) return 0;
+  return (int) ((ns + 999999LL) / 1000000LL);
+}
+
+/* Find the active transaction on fd */
+static struct xact *find_active(int fd) {
+
+  int i;
+
+  for(i = 0; i < MEAS_RS232_ENGINE_MAX; i++)
+    if(xacts[i].state == XACT_ACTIVE && xacts[i].fd == fd) return &xacts[i];
+  return NULL;
+}
+
+/* Transaction finished: stop watching the port */
+static void finish(struct xact *x, int status) {
+
+  x->state = XACT_DONE;
+  x->status = status;
+  x->reported = 0;
+  epoll_ctl(epfd, EPOLL_CTL_DEL, x->fd, NULL);
+}
+
+/* Send the command and start waiting for the reply. Returns 0 = waiting, 1 = finished. */
+static int start(struct xact *x) {
+
+  struct epoll_event ev;
+  int rv;
+
+  x->state = XACT_ACTIVE;
+  x->len = 0;
+  x->reply[0] = 0;
+  if(x->cmdlen && meas_rs232_write(x->fd, x->cmd, x->cmdlen) < 0) {
+    x->state = XACT_DONE;
+    x->status = MEAS_RS232_ERROR;
+    x->reported = 0;
+    return 1;
+  }
+  meas_rs232_deadline(&x->dl, x->timeout);
+  /* the reply may already be buffered */
+  if((rv = meas_rs232_readeot_nb(x->fd, x->reply, sizeof(x->reply), &x->len, x->eot, 0)) != 0) {
+    x->state = XACT_DONE;
+    x->status = (rv > 0)?MEAS_RS232_OK:MEAS_RS232_ERROR;
+    x->reported = 0;
+    return 1;
+  }
+  ev.events = EPOLLIN;
+  ev.data.fd = x->fd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, x->fd, &ev) < 0) {
+    x->state = XACT_DONE;
+    x->status = MEAS_RS232_ERROR;
+    x->reported = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/* Start the oldest queued transaction on fd (if any); repeat while they finish immediately */
+static void start_next(int fd) {
+
+  int i;
+  struct xact *x;
+
+  while(1) {
+    x = NULL;
+    for(i = 0; i < MEAS_RS232_ENGINE_MAX; i++)
+      if(xacts[i].state == XACT_QUEUED && xacts[i].fd == fd && (!x || xacts[i].seq < x->seq)) x = &xacts[i];
+    if(!x || !start(x)) return;
+  }
+}
+
+/*
+ * Submit a transaction. The command is sent right away if the port is
+ * idle, otherwise after the earlier transactions to the same port.
+ *
+ * fd      = RS232 port (opened with meas_rs232_open()).
+ * cmd     = Command to send (may be NULL if len is 0).
+ * len     = Command length.
+ * eot     = Reply terminator string.
+ * timeout = Reply timeout in seconds (counted from sending the command).
+ *
+ * Returns transaction handle or -1 on error.
+ *
+ */
+
+EXPORT int meas_rs232_engine_submit(int fd, char *cmd, int len, char *eot, double timeout) {
+
+  int i;
+  struct xact *x;
+
+  if(len > MEAS_RS232_ENGINE_CMDLEN || strlen(eot) >= MEAS_RS232_ENGINE_EOTLEN || !eot[0])
+    meas_err("meas_rs232_engine_submit: Command or terminator too long.");
+  if(epfd == -1 && (epfd = epoll_create(MEAS_RS232_ENGINE_MAX)) < 0)
+    meas_err("meas_rs232_engine_submit: Can't create epoll instance.");
+  for(i = 0; i < MEAS_RS232_ENGINE_MAX; i++)
+    if(xacts[i].state == XACT_FREE) break;
+  if(i == MEAS_RS232_ENGINE_MAX)
+    meas_err("meas_rs232_engine_submit: Too many transactions pending.");
+  x = &xacts[i];
+  x->fd = fd;
+  if(len) memcpy(x->cmd, cmd, len);
+  x->cmdlen = len;
+  strcpy(x->eot, eot);
+  x->timeout = timeout;
+  x->seq = seq++;
+  x->state = XACT_QUEUED;
+  if(!find_active(fd)) start_next(fd);
+  return i;
+}
+
+/* Milliseconds until the earliest reply deadline (-1 if nothing is active) */
+static int next_deadline() {
+
+  int i, ms = -1, ms2;
+
+  for(i = 0; i < MEAS_RS232_ENGINE_MAX; i++)
+    if(xacts[i].state == XACT_ACTIVE) {
+      ms2 = ms_left(&xacts[i].dl);
+      if(ms == -1 || ms2 < ms) ms = ms2;
+    }
+  return ms;
+}
+
+/* Wait up to ms milliseconds for port events and process them (also expire transactions) */
+static int step(int ms) {
+
+  struct epoll_event ev[MEAS_RS232_ENGINE_MAX];
+  struct xact *x;
+  int i, n, rv, fd;
+
+  if((n = epoll_wait(epfd, ev, MEAS_RS232_ENGINE_MAX, ms)) < 0) {
+    if(errno == EINTR) return 0;
+    meas_err("meas_rs232_engine: epoll_wait failed.");
+  }
+  for(i = 0; i < n; i++) {
+    fd = ev[i].data.fd;
+    if(!(x = find_active(fd))) continue;
+    rv = meas_rs232_readeot_nb(fd, x->reply, sizeof(x->reply), &x->len, x->eot, 1);
+    if(rv == 0) continue;
+    finish(x, (rv > 0)?MEAS_RS232_OK:MEAS_RS232_ERROR);
+    start_next(fd);
+  }
+  /* expire transactions past their deadline */
+  for(i = 0; i < MEAS_RS232_ENGINE_MAX; i++) {
+    x = &xacts[i];
+    if(x->state == XACT_ACTIVE && !ms_left(&x->dl)) {
+      fd = x->fd;
+      finish(x, MEAS_RS232_TIMEDOUT);
+      meas_rs232_flush(fd);  /* drop partial reply so it does not end up in the next one */
+      start_next(fd);
+    }
+  }
+  return 0;
+}
+
+/*
+ * Wait for the next completed transaction.
+ *
+ * timeout = Maximum time to wait in seconds (< 0 = until something completes).
+ *
+ * Returns handle of a completed (or timed out) transaction, which must be
+ * collected with meas_rs232_engine_result(), or -1 if nothing is pending
+ * or the wait timed out.
+ *
+ */
+
+EXPORT int meas_rs232_engine_next(double timeout) {
+
+  struct timespec end;
+  int i, ms, ms2;
+
+  if(timeout >= 0.0) meas_rs232_deadline(&end, timeout);
+  while(1) {
+    for(i = 0; i < MEAS_RS232_ENGINE_MAX; i++)
+      if(xacts[i].state == XACT_DONE && !xacts[i].reported) {
+	xacts[i].reported = 1;
+	return i;
+      }
+    if((ms = next_deadline()) == -1) return -1;  /* nothing pending */
+    if(timeout >= 0.0) {
+      if(meas_rs232_expired(&end)) return -1;
+      ms2 = ms_left(&end);
+      if(ms2 < ms) ms = ms2;
+    }
+    if(step(ms) < 0) return -1;
+  }
+}
+
+/*
+ * Collect the result of a completed transaction and release the handle.
+ *
+ * handle = Transaction handle.
+ * buf    = Reply (including the terminator; at most MEAS_RS232_ENGINE_REPLYLEN bytes).
+ *          If the transaction timed out, this contains the partial reply.
+ * status = MEAS_RS232_OK, MEAS_RS232_TIMEDOUT or MEAS_RS232_ERROR.
+ *
+ * Returns the reply length or -1 if the transaction has not completed.
+ *
+ */
+
+EXPORT int meas_rs232_engine_result(int handle, char *buf, int *status) {
+
+  struct xact *x;
+
+  if(handle < 0 || handle >= MEAS_RS232_ENGINE_MAX || xacts[handle].state != XACT_DONE)
+    meas_err("meas_rs232_engine_result: Transaction not completed.");
+  x = &xacts[handle];
+  memcpy(buf, x->reply, x->len);
+  buf[x->len] = 0;
+  *status = x->status;
+  x->state = XACT_FREE;
+  return x->len;
+}
+
+/*
+ * Run all pending transactions to completion.
+ *
+ * timeout = Maximum time to wait in seconds (< 0 = no limit).
+ *
+ * Returns 0 when all transactions have completed (collect them with
+ * meas_rs232_engine_result()) or -1 on timeout.
+ *
+ */
+
+EXPORT int meas_rs232_engine_wait_all(double timeout) {
+
+  struct timespec end;
+  int ms, ms2;
+
+  if(timeout >= 0.0) meas_rs232_deadline(&end, timeout);
+  while((ms = next_deadline()) != -1) {
+    if(timeout >= 0.0) {
+      if(meas_rs232_expired(&end)) return -1;
+      ms2 = ms_left(&end);
+      if(ms2 < ms) ms = ms2;
+    }
+    if(step(ms) < 0) return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,12 @@
+/*
+ * RS232 transaction engine limits.
+ *
+ */
+
+/* Maximum number of transactions (queued, active or uncollected) */
+#define MEAS_RS232_ENGINE_MAX 32
+
+/* Maximum command, reply and terminator lengths */
+#define MEAS_RS232_ENGINE_CMDLEN   256
+#define MEAS_RS232_ENGINE_REPLYLEN 512
+#define MEAS_RS232_ENGINE_EOTLEN   8
@@ -10,58 +10,595 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/serial.h>
 #include "serial.h"
 #include "misc.h"
 
+/*
+ * Per-port state. Bytes are read from the kernel in as large chunks as
+ * are available and kept in a receive ring buffer, so that the line
+ * readers below do not need one read() per character. Bytes beyond the
+ * terminator stay in the buffer for the next call.
+ *
+ */
+
+struct port {
+  int fd;                           /* RS232 file descriptor (-1 = free slot) */
+  char rbuf[MEAS_RS232_RBUF_SIZE];  /* receive ring buffer */
+  int rhead;                        /* index of the first unread byte */
+  int rcount;                       /* number of unread bytes */
+  double timeout;                   /* default read timeout (s; 0 = wait forever) */
+  struct iovec biov[MEAS_RS232_BATCH_MAX];  /* queued batch commands */
+  char *beot[MEAS_RS232_BATCH_MAX];         /* reply terminators (NULL = no reply) */
+  int ncmd;                         /* number of commands in batch */
+  int nreply;                       /* next command to match a reply to */
+  int low_latency;                  /* ASYNC_LOW_LATENCY: 1 = set, 0 = not set, -1 = not supported */
+  int latency_timer;                /* USB-serial latency timer (ms; -1 = none) */
+  FILE *cap;                        /* traffic capture file (NULL = off) */
+  char name[64];                    /* device name */
+  int stats_on;                     /* collect statistics */
+  struct meas_rs232_stats st;       /* statistics */
+  struct timespec req;              /* time of the last write (request) */
+  int wait_first, wait_eot;         /* request waiting for first byte / terminator */
+};
+
+static struct port ports[MEAS_RS232_MAXPORTS];
+static int been_here = 0;
+static long nsyscalls = 0;
+
+/* Allocate port slot for fd (NULL if out of slots) */
+static struct port *port_alloc(int fd) {
+
+  int i;
+
+  if(!been_here) {
+    for(i = 0; i < MEAS_RS232_MAXPORTS; i++)
+      ports[i].fd = -1;
+    been_here = 1;
+  }
+  for(i = 0; i < MEAS_RS232_MAXPORTS; i++)
+    if(ports[i].fd == -1) {
+      ports[i].fd = fd;
+      ports[i].rhead = ports[i].rcount = 0;
+      ports[i].timeout = MEAS_RS232_TIMEOUT;
+      ports[i].ncmd = ports[i].nreply = 0;
+      ports[i].low_latency = 0;
+      ports[i].latency_timer = -1;
+      ports[i].cap = NULL;
+      ports[i].name[0] = 0;
+      ports[i].stats_on = 0;
+      return &ports[i];
+    }
+  return NULL;
+}
+
+/* Find port slot for fd (NULL if not opened through meas_rs232_open) */
+static struct port *port_find(int fd) {
+
+  int i;
+
+  if(!been_here) return NULL;
+  for(i = 0; i < MEAS_RS232_MAXPORTS; i++)
+    if(ports[i].fd == fd) return &ports[i];
+  return NULL;
+}
+
+/* Set dl to timeout seconds from now (CLOCK_MONOTONIC) */
+static void deadline_set(struct timespec *dl, double timeout) {
+
+  clock_gettime(CLOCK_MONOTONIC, dl);
+  dl->tv_sec += (time_t) timeout;
+  dl->tv_nsec += (long) ((timeout - (double) (time_t) timeout) * 1E9);
+  if(dl->tv_nsec >= 1000000000L) {
+    dl->tv_sec++;
+    dl->tv_nsec -= 1000000000L;
+  }
+}
+
+/* Append a record to the capture file of the port (see serial.h for the format) */
+static void capture(struct port *p, int dir, char *buf, int len) {
+
+  struct timespec now;
+  unsigned long long t;
+  unsigned char hdr[13];
+  int i;
+
+  if(!p || !p->cap || len <= 0) return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  t = (unsigned long long) now.tv_sec * 1000000000ULL + (unsigned long long) now.tv_nsec;
+  for (i = 0; i < 8; i++)
+    hdr[i] = (t >> (8 * i)) & 0xff;
+  hdr[8] = dir;
+  for (i = 0; i < 4; i++)
+    hdr[9 + i] = (((unsigned int) len) >> (8 * i)) & 0xff;
+  fwrite(hdr, sizeof(hdr), 1, p->cap);
+  fwrite(buf, len, 1, p->cap);
+}
+
+/* Add the time since the last request to latency histogram */
+static void stats_hist(struct port *p, long *hist) {
+
+  struct timespec now;
+  long long us;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  us = ((long long) (now.tv_sec - p->req.tv_sec) * 1000000000LL + (now.tv_nsec - p->req.tv_nsec)) / 1000LL;
+  for (i = 0; i < MEAS_RS232_HIST_BINS - 1 && us >= 2; i++, us >>= 1);
+  hist[i]++;
+}
+
+/* Bytes read */
+static void stats_read(struct port *p, int n) {
+
+  if(!p || !p->stats_on) return;
+  p->st.reads++;
+  p->st.bytes_in += n;
+  if(p->wait_first) {
+    stats_hist(p, p->st.first_byte);
+    p->wait_first = 0;
+  }
+}
+
+/* Bytes written (starts a new request) */
+static void stats_write(struct port *p, int n) {
+
+  if(!p || !p->stats_on) return;
+  p->st.writes++;
+  p->st.bytes_out += n;
+  clock_gettime(CLOCK_MONOTONIC, &p->req);
+  p->wait_first = p->wait_eot = 1;
+}
+
+/* Reply terminator found */
+static void stats_eot(struct port *p) {
+
+  if(!p || !p->stats_on || !p->wait_eot) return;
+  stats_hist(p, p->st.terminator);
+  p->wait_eot = 0;
+}
+
+/* Count reads that have to wait for data (costs one extra poll()) */
+static void stats_probe(struct port *p) {
+
+  struct pollfd pfd;
+
+  if(!p || !p->stats_on) return;
+  pfd.fd = p->fd;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, 0) == 0) p->st.would_block++;
+}
+
+/*
+ * Wait until fd has data or the deadline passes.
+ *
+ * dl = Absolute deadline (CLOCK_MONOTONIC) or NULL to wait forever.
+ *
+ * Returns 1 if data is available, 0 on timeout and -1 on error.
+ *
+ */
+
+static int port_wait(int fd, struct timespec *dl) {
+
+  struct pollfd pfd;
+  struct timespec now;
+  long long ns;
+  int rv;
+
+  if(!dl) return 1;  /* read() will block */
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while(1) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (long long) (dl->tv_sec - now.tv_sec) * 1000000000LL + (dl->tv_nsec - now.tv_nsec);
+    if(ns < 0) ns = 0;
+    if((rv = poll(&pfd, 1, (int) ((ns + 999999LL) / 1000000LL))) > 0) return 1;
+    if(rv == 0) {
+      if(ns == 0) return 0;
+      continue; /* woke up a bit early */
+    }
+    if(errno != EINTR) return -1;
+  }
+}
+
+/*
+ * Read whatever the kernel has (at least one byte) into the ring buffer.
+ * This is the only place where buffered reads hit the kernel.
+ *
+ * dl = Absolute deadline (CLOCK_MONOTONIC) or NULL to wait forever.
+ *
+ * Returns the number of bytes added, 0 on timeout or -1 on error.
+ *
+ */
+
+static int port_fill(struct port *p, struct timespec *dl) {
+
+  int tail, space, len, rv;
+
+  if(!p->rcount) p->rhead = 0;  /* maximize contiguous space */
+  tail = (p->rhead + p->rcount) % MEAS_RS232_RBUF_SIZE;
+  if(tail >= p->rhead && p->rcount < MEAS_RS232_RBUF_SIZE) space = MEAS_RS232_RBUF_SIZE - tail;
+  else space = p->rhead - tail;
+  if(space <= 0) return -1;  /* full (can't happen - we only fill when empty) */
+  stats_probe(p);
+  while(1) {
+    if((rv = port_wait(p->fd, dl)) <= 0) return rv;
+    nsyscalls++;
+    if((len = read(p->fd, p->rbuf + tail, space)) > 0) break;
+    if(len == 0 || errno != EINTR) return -1;
+  }
+  capture(p, MEAS_RS232_CAPTURE_RX, p->rbuf + tail, len);
+  stats_read(p, len);
+  p->rcount += len;
+  return len;
+}
+
+/* Get next byte from the port (buffered if possible). Returns 1 = OK, 0 = timeout, -1 = error. */
+static int port_getc(int fd, struct port *p, char *c, struct timespec *dl) {
+
+  int rv;
+
+  if(!p) {
+    if((rv = port_wait(fd, dl)) <= 0) return rv;
+    nsyscalls++;
+    return (read(fd, c, 1) == 1)?1:-1;
+  }
+  if(!p->rcount && (rv = port_fill(p, dl)) <= 0) return rv;
+  *c = p->rbuf[p->rhead];
+  p->rhead = (p->rhead + 1) % MEAS_RS232_RBUF_SIZE;
+  p->rcount--;
+  return 1;
+}
+
+/*
+ * Read until one of the two terminators (eot2 may be NULL) is found.
+ *
+ * Returns the number of bytes stored in buf (including the terminator) or -1 on error.
+ * which is set to the terminator found (1 or 2) or 0 if the deadline passed
+ * or maxlen bytes were read without a terminator. buf is not NULL terminated.
+ *
+ */
+
+static int port_readeot(int fd, char *buf, int maxlen, char *eot1, int len1, char *eot2, int len2, struct timespec *dl, int *which) {
+
+  int i = 0, rv;
+  struct port *p = port_find(fd);
+
+  *which = 0;
+  while(i < maxlen) {
+    if((rv = port_getc(fd, p, buf + i, dl)) < 0) return -1;
+    if(rv == 0) break;
+    i++;
+    if(i >= len1 && !memcmp(buf + i - len1, eot1, len1)) {
+      *which = 1;
+      break;
+    }
+    if(eot2 && i >= len2 && !memcmp(buf + i - len2, eot2, len2)) {
+      *which = 2;
+      break;
+    }
+  }
+  if(*which) stats_eot(p);
+  return i;
+}
+
+/* Read len bytes. Returns the number of bytes read (< len on timeout) or -1 on error. */
+static int port_read(int fd, char *buf, int len, struct timespec *dl) {
+
+  int len2 = 0, n, rv;
+  struct port *p = port_find(fd);
+
+  while (len2 < len) {
+    if(p && p->rcount) { /* use buffered data first */
+      n = len - len2;
+      if(n > p->rcount) n = p->rcount;
+      if(n > MEAS_RS232_RBUF_SIZE - p->rhead) n = MEAS_RS232_RBUF_SIZE - p->rhead;
+      memcpy(buf + len2, p->rbuf + p->rhead, n);
+      p->rhead = (p->rhead + n) % MEAS_RS232_RBUF_SIZE;
+      p->rcount -= n;
+    } else if(p && len - len2 < MEAS_RS232_RBUF_SIZE / 2) { /* short reads go through the buffer */
+      if((rv = port_fill(p, dl)) <= 0) return (rv < 0)?-1:len2;
+      continue;
+    } else { /* long reads go directly to the caller's buffer */
+      stats_probe(p);
+      if((rv = port_wait(fd, dl)) <= 0) return (rv < 0)?-1:len2;
+      nsyscalls++;
+      if((n = read(fd, buf + len2, len - len2)) <= 0) return -1;
+      capture(p, MEAS_RS232_CAPTURE_RX, buf + len2, n);
+      stats_read(p, n);
+    }
+    len2 += n;
+  }
+  return len2;
+}
+
+/* Deadline from the port default timeout (NULL = no timeout) */
+static struct timespec *port_deadline(int fd, struct timespec *dl) {
+
+  struct port *p = port_find(fd);
+
+  if(!p || p->timeout <= 0.0) return NULL;
+  deadline_set(dl, p->timeout);
+  return dl;
+}
+
+/*
+ * Linux termios2 interface for arbitrary line speeds (BOTHER). Declared here
+ * since <asm/termbits.h> clashes with <termios.h>.
+ *
+ */
+
+struct meas_termios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+
+#define RS232_TCGETS2 _IOR('T', 0x2A, struct meas_termios2)
+#define RS232_TCSETS2 _IOW('T', 0x2B, struct meas_termios2)
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+
+/* Standard termios speeds */
+static struct {
+  int rate;
+  speed_t code;
+} std_speeds[] = {
+  {1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200},
+  {38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400},
+  {460800, B460800}, {921600, B921600}, {0, 0}
+};
+
+/* Set arbitrary line speed with termios2. Returns 0 on success, -1 on error. */
+static int set_bother(int fd, int rate) {
+
+  struct meas_termios2 tio;
+
+  if(ioctl(fd, RS232_TCGETS2, &tio) < 0) return -1;
+  tio.c_cflag &= ~CBAUD;
+  tio.c_cflag |= BOTHER;
+  tio.c_cflag &= ~(CBAUD << IBSHIFT);  /* input speed = output speed */
+  tio.c_ispeed = tio.c_ospeed = rate;
+  return ioctl(fd, RS232_TCSETS2, &tio);
+}
+
+/*
+ * Print I/O statistics and latency histograms of RS232 port to stderr.
+ *
+ * fd = File descriptor for the RS232 port.
+ *
+ */
+
+EXPORT int meas_rs232_stats_print(int fd) {
+
+  struct port *p;
+  int i;
+
+  if(!(p = port_find(fd)) || !p->stats_on) meas_err("meas_rs232_stats_print: No statistics for port.");
+  fprintf(stderr, "libmeas: RS232 %s (fd %d): %ld bytes in, %ld bytes out, %ld reads (%ld would block), %ld writes\n",
+	  p->name, fd, p->st.bytes_in, p->st.bytes_out, p->st.reads, p->st.would_block, p->st.writes);
+  fprintf(stderr, "  latency (us)          first byte  terminator\n");
+  for (i = 0; i < MEAS_RS232_HIST_BINS; i++) {
+    if(!p->st.first_byte[i] && !p->st.terminator[i]) continue;
+    if(i == MEAS_RS232_HIST_BINS - 1) fprintf(stderr, "  >= %-17ld", 1L << i);
+    else fprintf(stderr, "  %8ld - %-8ld ", i?(1L << i):0L, 1L << (i + 1));
+    fprintf(stderr, " %11ld %11ld\n", p->st.first_byte[i], p->st.terminator[i]);
+  }
+  return 0;
+}
+
+/* Print statistics of all ports that collect them (atexit handler) */
+static void stats_dump() {
+
+  int i;
+
+  for(i = 0; i < MEAS_RS232_MAXPORTS; i++)
+    if(ports[i].fd != -1 && ports[i].stats_on) meas_rs232_stats_print(ports[i].fd);
+}
+
+/*
+ * Enable/disable collecting I/O statistics for RS232 port.
+ *
+ * fd = File descriptor for the RS232 port.
+ * on = 1 = enable (and reset counters), 0 = disable.
+ *
+ * The statistics are printed when the port is closed (or at exit).
+ * Note that this costs one extra poll() per read (to count the reads
+ * that would block) and time stamps for each read and write.
+ *
+ */
+
+EXPORT int meas_rs232_stats_enable(int fd, int on) {
+
+  static int atexit_done = 0;
+  struct port *p;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_stats_enable: Port not open.");
+  if(on) {
+    memset(&p->st, 0, sizeof(p->st));
+    p->wait_first = p->wait_eot = 0;
+    if(!atexit_done) {
+      atexit(stats_dump);
+      atexit_done = 1;
+    }
+  }
+  p->stats_on = on;
+  return 0;
+}
+
+/*
+ * Get I/O statistics for RS232 port (see meas_rs232_stats_enable()).
+ *
+ * fd = File descriptor for the RS232 port.
+ * st = Statistics (see serial.h).
+ *
+ * Latency histograms: bin i counts replies that took 2^i - 2^(i+1) us
+ * (bin 0: < 2 us) from the last write to the first byte of the reply
+ * (first_byte) or to its terminator (terminator; line/terminator reads only).
+ *
+ */
+
+EXPORT int meas_rs232_stats(int fd, struct meas_rs232_stats *st) {
+
+  struct port *p;
+
+  if(!(p = port_find(fd)) || !p->stats_on) meas_err("meas_rs232_stats: No statistics for port.");
+  *st = p->st;
+  return 0;
+}
+
+/*
+ * Record all traffic on RS232 port to a file.
+ *
+ * fd   = File descriptor for the RS232 port.
+ * file = Capture file name (NULL = stop capturing).
+ *
+ * Every chunk transmitted or received is stored with its CLOCK_MONOTONIC
+ * time stamp (format in serial.h). The capture can be served on a pty
+ * with examples/rs232-replay to run drivers without the instrument.
+ *
+ */
+
+EXPORT int meas_rs232_capture(int fd, char *file) {
+
+  struct port *p;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_capture: Port not open.");
+  if(p->cap) {
+    fclose(p->cap);
+    p->cap = NULL;
+  }
+  if(!file) return 0;
+  if(!(p->cap = fopen(file, "w"))) meas_err("meas_rs232_capture: Can't open capture file.");
+  fwrite(MEAS_RS232_CAPTURE_MAGIC, 8, 1, p->cap);
+  return 0;
+}
+
+/* Set ASYNC_LOW_LATENCY. Returns 1 = set, -1 = not supported by the driver. */
+static int set_low_latency(int fd) {
+
+  struct serial_struct ser;
+
+  if(ioctl(fd, TIOCGSERIAL, &ser) < 0) return -1;
+  ser.flags |= ASYNC_LOW_LATENCY;
+  if(ioctl(fd, TIOCSSERIAL, &ser) < 0) return -1;
+  if(ioctl(fd, TIOCGSERIAL, &ser) < 0) return -1;
+  return (ser.flags & ASYNC_LOW_LATENCY)?1:-1;
+}
+
+/*
+ * Lower the latency timer of an FTDI adapter (the driver exposes it in sysfs).
+ * Returns the timer value in effect (ms) or -1 if the device has none.
+ *
+ */
+
+static int set_latency_timer(char *dev) {
+
+  char path[PATH_MAX], name[PATH_MAX], *base;
+  FILE *fp;
+  int val = -1;
+
+  if(!realpath(dev, name)) return -1;  /* resolve /dev/serial/by-id links */
+  base = (base = strrchr(name, '/'))?base+1:name;
+  if(snprintf(path, sizeof(path), "/sys/bus/usb-serial/devices/%s/latency_timer", base) >= (int) sizeof(path))
+    return -1;
+  meas_misc_root_on();
+  if((fp = fopen(path, "w"))) {
+    fprintf(fp, "%d\n", MEAS_RS232_LATENCY_TIMER);
+    fclose(fp);
+  }
+  meas_misc_root_off();
+  if((fp = fopen(path, "r"))) {
+    if(fscanf(fp, "%d", &val) != 1) val = -1;
+    fclose(fp);
+  }
+  return val;
+}
+
 /*
  * Open RS232 port.
  *
  * dev   = RS232 devince name.
- * speed = line speed (see serial.h).
+ * speed = line speed: one of the MEAS_B* constants (see serial.h) or the
+ *         baud rate as an integer (e.g. 230400, 921600 or 250000). Add
+ *         MEAS_NOHANDSHAKE to disable CTS/RTS handshake and MEAS_LOWLATENCY
+ *         to minimize the reply latency of USB-serial adapters (sets
+ *         ASYNC_LOW_LATENCY and lowers the FTDI latency timer; see
+ *         meas_rs232_latency() for what was applied).
+ *
+ * If environment variable MEAS_RS232_CAPTURE is set, all traffic is recorded
+ * to file $MEAS_RS232_CAPTURE-<device>.cap (see meas_rs232_capture()).
+ * If MEAS_RS232_STATS is set, I/O statistics are collected for the port and
+ * printed at exit (see meas_rs232_stats()).
  *
- * Note: Returns file descriptor for the RS232 device.
+ * Note: Returns file descriptor for the RS232 device. Drivers may not be able
+ *       to produce the exact rate requested; use meas_rs232_speed() to get the
+ *       rate that was actually set.
  *
  */
 
 EXPORT int meas_rs232_open(char *dev, int speed) {
 
   struct termios newtio;
-  int fd;
+  struct port *p;
+  int fd, i, rate, lowlat;
+  char *cap, *base, capfile[PATH_MAX];
   unsigned char handshake;
 
+  lowlat = (speed & MEAS_LOWLATENCY)?1:0;
+  speed &= ~MEAS_LOWLATENCY;
   if(speed & MEAS_NOHANDSHAKE) {
-    speed &= ~MEAS_NOHANDSHAKE;   /* if speed < 0, no handshake */
+    speed &= ~MEAS_NOHANDSHAKE;
     handshake = 0;
   } else handshake = 1; /* cts/rts handshake */
-  meas_misc_root_on();
-  if((fd = open(dev, O_RDWR | O_NOCTTY | O_NDELAY)) < 0)
-    meas_err("meas_serial_open: Can't open device.");
-  tcgetattr(fd, &newtio);
   switch (speed) {
   case MEAS_B9600:
-    cfsetispeed(&newtio, B9600);
-    cfsetospeed(&newtio, B9600);
+    rate = 9600;
     break;
   case MEAS_B19200:
-    cfsetispeed(&newtio, B19200);
-    cfsetospeed(&newtio, B19200);
+    rate = 19200;
     break;
   case MEAS_B57600:
-    cfsetispeed(&newtio, B57600);
-    cfsetospeed(&newtio, B57600);
+    rate = 57600;
     break;
   case MEAS_B38400:
-    cfsetispeed(&newtio, B38400);
-    cfsetospeed(&newtio, B38400);
+    rate = 38400;
     break;
   case MEAS_B115200:
-    cfsetispeed(&newtio, B115200);
-    cfsetospeed(&newtio, B115200);
+    rate = 115200;
     break;
   default:
-    fprintf(stderr, "libmeas: Unknown baud rate.\n");
-    exit(0);
+    rate = speed;
   }
+  if(rate < 50) meas_err("meas_rs232_open: Illegal baud rate.");
+  for (i = 0; std_speeds[i].rate; i++)
+    if(std_speeds[i].rate == rate) break;
+
+  meas_misc_root_on();
+  fd = open(dev, O_RDWR | O_NOCTTY | O_NDELAY);
+  meas_misc_root_off();   /* the descriptor is all we need from now on */
+  if(fd < 0)
+    meas_err("meas_serial_open: Can't open device.");
+  tcgetattr(fd, &newtio);
+  /* non-standard rates are set below with termios2 */
+  cfsetispeed(&newtio, std_speeds[i].rate?std_speeds[i].code:B9600);
+  cfsetospeed(&newtio, std_speeds[i].rate?std_speeds[i].code:B9600);
   newtio.c_cflag &= ~PARENB;
   newtio.c_cflag &= ~CSTOPB;
   newtio.c_cflag &= ~CSIZE;
@@ -76,18 +613,112 @@ EXPORT int meas_rs232_open(char *dev, int speed) {
     newtio.c_cflag |= CRTSCTS;
   else
     newtio.c_cflag &= ~CRTSCTS;
-  newtio.c_cc[VTIME]    = 100;    /* inter-character timer unused */
-  newtio.c_cc[VMIN]     = 10;     /* blocking read until 1 character arrives */
+  newtio.c_cc[VTIME]    = 0;      /* inter-character timer unused */
+  newtio.c_cc[VMIN]     = 1;      /* read returns what is available (at least 1 char) */
   
   if(tcflush(fd, TCIFLUSH) < 0) meas_err("serial: TCIFLUSH failed.");
   if(tcsetattr(fd, TCSANOW, &newtio) < 0) meas_err("serial: TCSANOW failed.");
+  if(!std_speeds[i].rate && set_bother(fd, rate) < 0) {
+    close(fd);
+    meas_err("meas_rs232_open: Baud rate not supported by the device.");
+  }
   
   fcntl(fd, F_SETFL, 0); /* FIXME: somehow the above set non-blocking I/O */
+  p = port_alloc(fd);  /* no buffering if out of slots */
+  if(p) {
+    strncpy(p->name, dev, sizeof(p->name) - 1);
+    p->name[sizeof(p->name) - 1] = 0;
+    if(getenv("MEAS_RS232_STATS")) meas_rs232_stats_enable(fd, 1);
+  }
+  if(p && (cap = getenv("MEAS_RS232_CAPTURE"))) {  /* capture without changing the program */
+    base = (base = strrchr(dev, '/'))?base+1:dev;
+    snprintf(capfile, sizeof(capfile), "%s-%s.cap", cap, base);
+    meas_rs232_capture(fd, capfile);
+  }
+  if(lowlat) {
+    i = set_low_latency(fd);
+    rate = set_latency_timer(dev);
+    if(p) {
+      p->low_latency = i;
+      p->latency_timer = rate;
+    }
+  }
   
-  meas_misc_root_off();
   return fd;
 }
 
+/*
+ * Use the buffered read functions on a descriptor that was not opened with
+ * meas_rs232_open() (e.g. a TCP socket). Timeouts, capture and statistics
+ * work as for RS232 ports; close with meas_rs232_close().
+ *
+ * fd   = Open file descriptor (stream).
+ * name = Name for capture files and statistics.
+ *
+ * Returns fd.
+ *
+ */
+
+EXPORT int meas_rs232_attach(int fd, char *name) {
+
+  struct port *p;
+
+  if(port_find(fd)) return fd;
+  if(!(p = port_alloc(fd)))
+    meas_err("meas_rs232_attach: Too many ports open (increase MEAS_RS232_MAXPORTS).");
+  strncpy(p->name, name, sizeof(p->name) - 1);
+  p->name[sizeof(p->name) - 1] = 0;
+  if(getenv("MEAS_RS232_STATS")) meas_rs232_stats_enable(fd, 1);
+  return fd;
+}
+
+/*
+ * Return the line speed (baud) currently set for RS232 port.
+ *
+ * fd = File descriptor for the RS232 port.
+ *
+ * This is the rate that the driver actually achieved, which may differ from
+ * the one requested in meas_rs232_open(). Returns -1 on error.
+ *
+ */
+
+EXPORT int meas_rs232_speed(int fd) {
+
+  struct meas_termios2 tio;
+  struct termios t;
+  speed_t code;
+  int i;
+
+  if(ioctl(fd, RS232_TCGETS2, &tio) == 0 && tio.c_ospeed) return (int) tio.c_ospeed;
+  /* no termios2: decode the standard speed */
+  if(tcgetattr(fd, &t) < 0) meas_err("meas_rs232_speed: Can't get port attributes.");
+  code = cfgetospeed(&t);
+  for (i = 0; std_speeds[i].rate; i++)
+    if(std_speeds[i].code == code) return std_speeds[i].rate;
+  meas_err("meas_rs232_speed: Unknown line speed.");
+}
+
+/*
+ * Report the low latency settings of RS232 port (see MEAS_LOWLATENCY).
+ *
+ * fd            = File descriptor for the RS232 port.
+ * low_latency   = ASYNC_LOW_LATENCY state: 1 = set, 0 = not requested,
+ *                 -1 = not supported by the driver.
+ * latency_timer = USB-serial latency timer in ms (-1 = not an FTDI device
+ *                 or not requested).
+ *
+ */
+
+EXPORT int meas_rs232_latency(int fd, int *low_latency, int *latency_timer) {
+
+  struct port *p;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_latency: Port not open.");
+  *low_latency = p->low_latency;
+  *latency_timer = p->latency_timer;
+  return 0;
+}
+
 /*
  * Close RS232 device.
  *
@@ -97,32 +728,39 @@ EXPORT int meas_rs232_open(char *dev, int speed) {
 
 EXPORT int meas_rs232_close(int fd) {
 
-  meas_misc_root_on();
+  struct port *p;
+
+  if((p = port_find(fd))) {
+    if(p->stats_on) meas_rs232_stats_print(fd);
+    if(p->cap) fclose(p->cap);
+    p->fd = -1;
+  }
   close(fd);
-  meas_misc_root_off();
   return 0;
 }
 
 /*
- * Read line from RS232 port.
+ * Read line from RS232 port (with specified end of line character).
  *
  * fd  = File descriptor for the RS232 port.
  * buf = Output buffer for data.
+ * eoc = End of line character.
+ *
+ * Waits at most the port default timeout (see meas_rs232_set_timeout()).
  *
  */
 
-EXPORT int meas_rs232_readnl(int fd, char *buf) {
+EXPORT int meas_rs232_readeoc(int fd, char *buf, char eoc) {
 
-  int i = 0;
+  int i, which;
+  struct timespec dl;
 
-  meas_misc_root_on();
-  while (1) {
-    meas_rs232_read(fd, buf + i, 1);
-    if(buf[i] == MEAS_SERIAL_EOS) break;
-    i++;
+  i = port_readeot(fd, buf, INT_MAX, &eoc, 1, NULL, 0, port_deadline(fd, &dl), &which);
+  if(i < 0 || !which) {
+    buf[(i > 0)?i:0] = 0;
+    meas_err("meas_rs232_readeoc: Serial line read failed or timed out.");
   }
-  meas_misc_root_off();
-  buf[i] = 0;
+  buf[i-1] = 0;
   return 0;
 }
 
@@ -134,19 +772,9 @@ EXPORT int meas_rs232_readnl(int fd, char *buf) {
  *
  */
 
-EXPORT int meas_rs232_readeoc(int fd, char *buf, char eoc) {
-
-  int i = 0;
+EXPORT int meas_rs232_readnl(int fd, char *buf) {
 
-  meas_misc_root_on();
-  while (1) {
-    meas_rs232_read(fd, buf + i, 1);
-    if(buf[i] == eoc) break;
-    i++;
-  }
-  meas_misc_root_off();
-  buf[i] = 0;
-  return 0;
+  return meas_rs232_readeoc(fd, buf, MEAS_SERIAL_EOS);
 }
 
 /*
@@ -156,21 +784,19 @@ EXPORT int meas_rs232_readeoc(int fd, char *buf, char eoc) {
  * buf = Output buffer for data.
  * eot = End of transmission string.
  *
+ * Waits at most the port default timeout (see meas_rs232_set_timeout()).
+ *
  */
 
 EXPORT int meas_rs232_readeot(int fd, char *buf, char *eot) {
 
-  int i = 0, len;
+  int i, which;
+  struct timespec dl;
 
-  len = strlen(eot);
-  meas_misc_root_on();
-  while (1) {
-    meas_rs232_read(fd, buf + i, 1);
-    i++;
-    if(i >= len && !strncmp(buf + i - len, eot, len)) break;
-  }
-  meas_misc_root_off();
-  buf[i] = 0;
+  i = port_readeot(fd, buf, INT_MAX, eot, strlen(eot), NULL, 0, port_deadline(fd, &dl), &which);
+  buf[(i > 0)?i:0] = 0;
+  if(i < 0 || !which)
+    meas_err("meas_rs232_readeot: Serial line read failed or timed out.");
   return 0;
 }
 
@@ -188,25 +814,13 @@ EXPORT int meas_rs232_readeot(int fd, char *buf, char *eot) {
 
 EXPORT int meas_rs232_readeot2(int fd, char *buf, char *eot1, char *eot2) {
 
-  int i = 0, len1, len2, which;
+  int i, which;
+  struct timespec dl;
 
-  len1 = strlen(eot1);
-  len2 = strlen(eot2);
-  meas_misc_root_on();
-  while (1) {
-    meas_rs232_read(fd, buf + i, 1);
-    i++;
-    if(i >= len1 && !strncmp(buf + i - len1, eot1, len1)) {
-      which = 1;
-      break;
-    }
-    if(i >= len2 && !strncmp(buf + i - len2, eot2, len2)) {
-      which = 2;
-      break;
-    }
-    }
-  meas_misc_root_off();
-  buf[i] = 0;
+  i = port_readeot(fd, buf, INT_MAX, eot1, strlen(eot1), eot2, strlen(eot2), port_deadline(fd, &dl), &which);
+  buf[(i > 0)?i:0] = 0;
+  if(i < 0 || !which)
+    meas_err("meas_rs232_readeot2: Serial line read failed or timed out.");
   return which;
 }
 
@@ -217,21 +831,238 @@ EXPORT int meas_rs232_readeot2(int fd, char *buf, char *eot1, char *eot2) {
  * buf = Output buffer for data.
  * len = Number of bytes (characters) to be read.
  *
+ * Waits at most the port default timeout (see meas_rs232_set_timeout()).
+ *
  */
 
 EXPORT int meas_rs232_read(int fd, char *buf, int len) {
 
-  int len2 = 0;
+  int len2;
+  struct timespec dl;
 
-  meas_misc_root_on();
-  while (len2 < len) {
-    if((len2 += read(fd, buf + len2, len - len2)) < 0)
-      meas_err("meas_serial_read: Serial line read failed.");
+  len2 = port_read(fd, buf, len, port_deadline(fd, &dl));
+  if(len2 != len)
+    meas_err("meas_serial_read: Serial line read failed or timed out.");
+  return 0;
+}
+
+/*
+ * Read line from RS232 port with a deadline.
+ *
+ * fd     = File descriptor for the RS232 port.
+ * buf    = Output buffer for data.
+ * maxlen = Size of buf (including the terminating NULL).
+ * eoc    = End of line character (not stored in buf).
+ * dl     = Absolute deadline (see meas_rs232_deadline()) or NULL for
+ *          the port default timeout.
+ * status = Set to MEAS_RS232_OK, MEAS_RS232_TIMEDOUT or MEAS_RS232_OVERFLOW.
+ *
+ * Returns the number of characters in buf (a partial line on timeout)
+ * or -1 on error.
+ *
+ */
+
+EXPORT int meas_rs232_readeoc_dl(int fd, char *buf, int maxlen, char eoc, struct timespec *dl, int *status) {
+
+  int i, which;
+  struct timespec dl2;
+
+  if(!dl) dl = port_deadline(fd, &dl2);
+  if((i = port_readeot(fd, buf, maxlen - 1, &eoc, 1, NULL, 0, dl, &which)) < 0)
+    meas_err("meas_rs232_readeoc_dl: Serial line read failed.");
+  if(which) {
+    *status = MEAS_RS232_OK;
+    i--;
+  } else *status = (i == maxlen - 1)?MEAS_RS232_OVERFLOW:MEAS_RS232_TIMEDOUT;
+  buf[i] = 0;
+  return i;
+}
+
+/*
+ * Read line from RS232 port (with specified end of transmission string) with a deadline.
+ *
+ * fd     = File descriptor for the RS232 port.
+ * buf    = Output buffer for data.
+ * maxlen = Size of buf (including the terminating NULL).
+ * eot    = End of transmission string (stored in buf as in meas_rs232_readeot()).
+ * dl     = Absolute deadline (see meas_rs232_deadline()) or NULL for
+ *          the port default timeout.
+ * status = Set to MEAS_RS232_OK, MEAS_RS232_TIMEDOUT or MEAS_RS232_OVERFLOW.
+ *
+ * Returns the number of characters in buf or -1 on error.
+ *
+ */
+
+EXPORT int meas_rs232_readeot_dl(int fd, char *buf, int maxlen, char *eot, struct timespec *dl, int *status) {
+
+  int i, which;
+  struct timespec dl2;
+
+  if(!dl) dl = port_deadline(fd, &dl2);
+  if((i = port_readeot(fd, buf, maxlen - 1, eot, strlen(eot), NULL, 0, dl, &which)) < 0)
+    meas_err("meas_rs232_readeot_dl: Serial line read failed.");
+  if(which) *status = MEAS_RS232_OK;
+  else *status = (i == maxlen - 1)?MEAS_RS232_OVERFLOW:MEAS_RS232_TIMEDOUT;
+  buf[i] = 0;
+  return i;
+}
+
+/*
+ * Read N bytes from RS232 port with a deadline.
+ *
+ * fd     = File descriptor for the RS232 port.
+ * buf    = Output buffer for data.
+ * len    = Number of bytes (characters) to be read.
+ * dl     = Absolute deadline (see meas_rs232_deadline()) or NULL for
+ *          the port default timeout.
+ * status = Set to MEAS_RS232_OK or MEAS_RS232_TIMEDOUT.
+ *
+ * Returns the number of bytes read (< len on timeout) or -1 on error.
+ *
+ */
+
+EXPORT int meas_rs232_read_dl(int fd, char *buf, int len, struct timespec *dl, int *status) {
+
+  int len2;
+  struct timespec dl2;
+
+  if(!dl) dl = port_deadline(fd, &dl2);
+  if((len2 = port_read(fd, buf, len, dl)) < 0)
+    meas_err("meas_rs232_read_dl: Serial line read failed.");
+  *status = (len2 == len)?MEAS_RS232_OK:MEAS_RS232_TIMEDOUT;
+  return len2;
+}
+
+/*
+ * Incremental (non-blocking) read of a line terminated by eot. Consumes
+ * buffered data and issues at most one read() per call, so that it can be
+ * driven from a poll()/epoll() loop.
+ *
+ * fd     = File descriptor for the RS232 port (opened with meas_rs232_open()).
+ * buf    = Output buffer for data (eot is stored as in meas_rs232_readeot()).
+ * maxlen = Size of buf (including the terminating NULL).
+ * pos    = Number of bytes already in buf (0 on the first call; updated).
+ * eot    = End of transmission string.
+ * ready  = 1 if the caller knows that fd is readable (e.g. from epoll) or
+ *          0 if we should check first. A read() is never issued if this is
+ *          0 and no data is pending.
+ *
+ * Returns 1 when eot has been received (buf is NULL terminated), 0 if not
+ * yet and -1 on error or if buf is full.
+ *
+ */
+
+EXPORT int meas_rs232_readeot_nb(int fd, char *buf, int maxlen, int *pos, char *eot, int ready) {
+
+  int len, rv, filled = 0;
+  struct port *p;
+  struct timespec now;
+
+  if(!(p = port_find(fd)))
+    meas_err("meas_rs232_readeot_nb: Port not opened with meas_rs232_open().");
+  len = strlen(eot);
+  while(*pos < maxlen - 1) {
+    if(!p->rcount) {
+      if(filled) return 0;
+      if(ready) rv = port_fill(p, NULL);
+      else {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        rv = port_fill(p, &now);
+      }
+      if(rv < 0) meas_err("meas_rs232_readeot_nb: Serial line read failed.");
+      if(rv == 0) return 0;
+      filled = 1;
+      continue;
+    }
+    buf[(*pos)++] = p->rbuf[p->rhead];
+    p->rhead = (p->rhead + 1) % MEAS_RS232_RBUF_SIZE;
+    p->rcount--;
+    if(*pos >= len && !memcmp(buf + *pos - len, eot, len)) {
+      buf[*pos] = 0;
+      stats_eot(p);
+      return 1;
+    }
   }
-  meas_misc_root_off();
+  buf[*pos] = 0;
+  meas_err("meas_rs232_readeot_nb: Buffer overflow.");
+}
+
+/*
+ * Set the default read timeout for a port. This applies to all reads
+ * that are not given an explicit deadline.
+ *
+ * fd      = File descriptor for the RS232 port.
+ * timeout = Timeout in seconds (0 = wait forever).
+ *
+ */
+
+EXPORT int meas_rs232_set_timeout(int fd, double timeout) {
+
+  struct port *p;
+
+  if(!(p = port_find(fd)))
+    meas_err("meas_rs232_set_timeout: Port not opened with meas_rs232_open().");
+  p->timeout = timeout;
+  return 0;
+}
+
+/*
+ * Discard all input that has been received but not read yet
+ * (e.g. a late reply to a command that timed out).
+ *
+ * fd = File descriptor for the RS232 port.
+ *
+ */
+
+EXPORT int meas_rs232_flush(int fd) {
+
+  struct port *p = port_find(fd);
+  struct pollfd pfd;
+  char buf[256];
+
+  if(p) p->rhead = p->rcount = 0;
+  if(tcflush(fd, TCIFLUSH) == 0) return 0;
+  /* not a tty: drain what is there */
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while(poll(&pfd, 1, 0) > 0) {
+    nsyscalls++;
+    if(read(fd, buf, sizeof(buf)) <= 0) break;
+  }
+  return 0;
+}
+
+/*
+ * Compute absolute deadline (for the *_dl read functions).
+ *
+ * dl      = Deadline to be set.
+ * timeout = Time from now in seconds.
+ *
+ */
+
+EXPORT int meas_rs232_deadline(struct timespec *dl, double timeout) {
+
+  deadline_set(dl, timeout);
   return 0;
 }
 
+/*
+ * Check if a deadline has passed.
+ *
+ * dl = Deadline (see meas_rs232_deadline()).
+ *
+ * Returns 1 if passed, 0 otherwise.
+ *
+ */
+
+EXPORT int meas_rs232_expired(struct timespec *dl) {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec > dl->tv_sec || (now.tv_sec == dl->tv_sec && now.tv_nsec >= dl->tv_nsec));
+}
+
 /*
  * Write data to RS232 port.
  *
@@ -243,14 +1074,19 @@ EXPORT int meas_rs232_read(int fd, char *buf, int len) {
 
 EXPORT int meas_rs232_write(int fd, char *buf, int len) {
 
-  int len2 = 0;
+  int len2 = 0, n;
+  struct port *p = port_find(fd);
 
-  meas_misc_root_on();
   while (len2 < len) {
-    if((len2 += write(fd, buf + len2, len - len2)) < 0)
+    nsyscalls++;
+    if((n = write(fd, buf + len2, len - len2)) < 0) {
+      if(errno == EINTR) continue;
       meas_err("meas_serial_write: Serial line write failed.");
+    }
+    capture(p, MEAS_RS232_CAPTURE_TX, buf + len2, n);
+    stats_write(p, n);
+    len2 += n;
   }
-  meas_misc_root_off();
   return 0;
 }
 
@@ -264,8 +1100,221 @@ EXPORT int meas_rs232_write(int fd, char *buf, int len) {
 
 EXPORT int meas_rs232_writeb(int fd, unsigned char byte) {
 
-  meas_misc_root_on();
-  meas_rs232_write(fd, &byte, 1);
-  meas_misc_root_off();
+  meas_rs232_write(fd, (char *) &byte, 1);
   return 0;
 }
+
+/*
+ * Framed replies of byte oriented instruments (e.g. DK240): the reply to a
+ * one byte command consists of an echo of the command, a fixed number of
+ * payload bytes, a status byte and a terminator byte (any of them optional;
+ * see struct meas_rs232_frame in serial.h). The whole frame is read with
+ * one buffered read instead of one read per field.
+ *
+ */
+
+/*
+ * Read and validate a reply frame.
+ *
+ * fd      = File descriptor for the RS232 port.
+ * spec    = Frame specification.
+ * payload = Payload bytes (spec->npayload; may be NULL if none).
+ * status  = Status byte (if spec->status; may be NULL).
+ *
+ * Waits at most the port default timeout. Returns 0 on success or -1 on
+ * error, timeout or if the echo or terminator does not match.
+ *
+ */
+
+EXPORT int meas_rs232_frame_read(int fd, struct meas_rs232_frame *spec, unsigned char *payload, int *status) {
+
+  unsigned char buf[MEAS_RS232_FRAME_MAX + 3];
+  struct timespec dl;
+  int len, i = 0;
+
+  if(spec->npayload < 0 || spec->npayload > MEAS_RS232_FRAME_MAX)
+    meas_err("meas_rs232_frame_read: Illegal payload length.");
+  len = (spec->echo >= 0) + spec->npayload + (spec->status != 0) + (spec->eot >= 0);
+  if(port_read(fd, (char *) buf, len, port_deadline(fd, &dl)) != len)
+    meas_err("meas_rs232_frame_read: Serial line read failed or timed out.");
+  if(spec->echo >= 0 && buf[i++] != spec->echo)
+    meas_err("meas_rs232_frame_read: Unexpected echo.");
+  if(spec->npayload && payload) memcpy(payload, buf + i, spec->npayload);
+  i += spec->npayload;
+  if(spec->status) {
+    if(status) *status = buf[i];
+    i++;
+  }
+  if(spec->eot >= 0 && buf[i] != spec->eot)
+    meas_err("meas_rs232_frame_read: Unexpected terminator.");
+  return 0;
+}
+
+/*
+ * Send a one byte command (with optional parameters) and read the reply frame.
+ *
+ * fd      = File descriptor for the RS232 port.
+ * cmd     = Command byte.
+ * params  = Parameter bytes (NULL = none). These are sent after the echo
+ *           of the command has been received.
+ * nparams = Number of parameter bytes.
+ * spec    = Frame specification of the reply (the echo is included).
+ * payload = Payload bytes.
+ * status  = Status byte.
+ *
+ * Returns 0 on success or -1 on error.
+ *
+ */
+
+EXPORT int meas_rs232_frame_cmd(int fd, unsigned char cmd, unsigned char *params, int nparams, struct meas_rs232_frame *spec, unsigned char *payload, int *status) {
+
+  struct meas_rs232_frame echo, rest;
+
+  if(meas_rs232_write(fd, (char *) &cmd, 1) < 0) return -1;
+  if(!nparams) return meas_rs232_frame_read(fd, spec, payload, status);
+  /* echo first, then parameters, then the rest of the frame */
+  echo.echo = spec->echo;
+  echo.npayload = echo.status = 0;
+  echo.eot = -1;
+  if(echo.echo >= 0 && meas_rs232_frame_read(fd, &echo, NULL, NULL) < 0) return -1;
+  if(meas_rs232_write(fd, (char *) params, nparams) < 0) return -1;
+  rest = *spec;
+  rest.echo = -1;
+  return meas_rs232_frame_read(fd, &rest, payload, status);
+}
+
+/*
+ * Command batches. Several commands are queued and then sent with a single
+ * writev() so that the instrument receives them back to back; the replies
+ * are then read in the order of the commands. Typical use:
+ *
+ *   meas_rs232_batch_begin(fd);
+ *   meas_rs232_batch_add(fd, "ET\r", 3, NULL);
+ *   meas_rs232_batch_add(fd, "?1\r", 3, "\r");
+ *   meas_rs232_batch_send(fd);
+ *   meas_rs232_batch_reply(fd, buf);
+ *
+ * Only use this with instruments that can buffer commands.
+ *
+ */
+
+/*
+ * Start a new command batch (discards any previous batch).
+ *
+ * fd = File descriptor for the RS232 port.
+ *
+ */
+
+EXPORT int meas_rs232_batch_begin(int fd) {
+
+  struct port *p;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_batch_begin: Port not open.");
+  p->ncmd = p->nreply = 0;
+  return 0;
+}
+
+/*
+ * Add command to the batch.
+ *
+ * fd  = File descriptor for the RS232 port.
+ * cmd = Command. Not copied - must remain valid until meas_rs232_batch_send().
+ * len = Command length.
+ * eot = Terminator of the reply to this command (NULL = no reply).
+ *
+ */
+
+EXPORT int meas_rs232_batch_add(int fd, char *cmd, int len, char *eot) {
+
+  struct port *p;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_batch_add: Port not open.");
+  if(p->ncmd == MEAS_RS232_BATCH_MAX) meas_err("meas_rs232_batch_add: Too many commands in batch.");
+  p->biov[p->ncmd].iov_base = cmd;
+  p->biov[p->ncmd].iov_len = len;
+  p->beot[p->ncmd] = eot;
+  p->ncmd++;
+  return 0;
+}
+
+/*
+ * Send all commands in the batch (one writev() unless the driver accepts
+ * only part of the data).
+ *
+ * fd = File descriptor for the RS232 port.
+ *
+ */
+
+EXPORT int meas_rs232_batch_send(int fd) {
+
+  struct port *p;
+  struct iovec *iov;
+  int niov;
+  ssize_t n;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_batch_send: Port not open.");
+  iov = p->biov;
+  niov = p->ncmd;
+  while(niov > 0) {
+    nsyscalls++;
+    if((n = writev(fd, iov, niov)) < 0) {
+      if(errno == EINTR) continue;
+      meas_err("meas_rs232_batch_send: Serial line write failed.");
+    }
+    stats_write(p, (int) n);
+    /* skip what was written */
+    while(niov > 0 && n >= (ssize_t) iov->iov_len) {
+      capture(p, MEAS_RS232_CAPTURE_TX, iov->iov_base, iov->iov_len);
+      n -= iov->iov_len;
+      iov++;
+      niov--;
+    }
+    if(niov > 0) {
+      capture(p, MEAS_RS232_CAPTURE_TX, iov->iov_base, n);
+      iov->iov_base = (char *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  p->nreply = 0;
+  return 0;
+}
+
+/*
+ * Read the reply to the next command in the sent batch that expects one.
+ *
+ * fd  = File descriptor for the RS232 port.
+ * buf = Reply (terminator included).
+ *
+ * Waits at most the port default timeout. Returns reply length or -1 on
+ * error, timeout or if no more replies are expected.
+ *
+ */
+
+EXPORT int meas_rs232_batch_reply(int fd, char *buf) {
+
+  struct port *p;
+  struct timespec dl;
+  int i, which;
+  char *eot;
+
+  if(!(p = port_find(fd))) meas_err("meas_rs232_batch_reply: Port not open.");
+  while(p->nreply < p->ncmd && !p->beot[p->nreply]) p->nreply++;
+  if(p->nreply == p->ncmd) meas_err("meas_rs232_batch_reply: No more replies expected.");
+  eot = p->beot[p->nreply++];
+  i = port_readeot(fd, buf, INT_MAX, eot, strlen(eot), NULL, 0, port_deadline(fd, &dl), &which);
+  buf[(i > 0)?i:0] = 0;
+  if(i < 0 || !which)
+    meas_err("meas_rs232_batch_reply: Serial line read failed or timed out.");
+  return i;
+}
+
+/*
+ * Return the total number of read() and write() system calls issued by
+ * the RS232 functions so far (for benchmarking).
+ *
+ */
+
+EXPORT long meas_rs232_syscalls() {
+
+  return nsyscalls;
+}
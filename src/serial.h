@@ -1,9 +1,72 @@
+#include <time.h>
+
+/* Line speeds for meas_rs232_open() (any other value is taken as the baud rate) */
 #define MEAS_B9600   1
 #define MEAS_B19200  2
 #define MEAS_B57600  4
 #define MEAS_B38400  8
 #define MEAS_B115200 16
 
-#define MEAS_NOHANDSHAKE 128
+/* Disable CTS/RTS handshake (add to speed) */
+#define MEAS_NOHANDSHAKE (1 << 30)
+
+/* Low latency mode for USB-serial adapters (add to speed) */
+#define MEAS_LOWLATENCY (1 << 29)
+
+/* FTDI latency timer (ms) used in low latency mode (driver default is 16 ms) */
+#define MEAS_RS232_LATENCY_TIMER 1
 
 #define MEAS_SERIAL_EOS '\r'
+
+/* Maximum number of simultaneously open RS232 ports (with receive buffering) */
+#define MEAS_RS232_MAXPORTS 16
+
+/* Receive buffer size (bytes) for each port */
+#define MEAS_RS232_RBUF_SIZE 4096
+
+/* Maximum number of commands in a batch (see meas_rs232_batch_begin()) */
+#define MEAS_RS232_BATCH_MAX 16
+
+/* Default read timeout (s) for new ports (0 = wait forever) */
+#define MEAS_RS232_TIMEOUT 0.0
+
+/* Status codes for the *_dl read functions and the serial engine */
+#define MEAS_RS232_OK       0
+#define MEAS_RS232_TIMEDOUT 1
+#define MEAS_RS232_OVERFLOW 2
+#define MEAS_RS232_ERROR    3
+
+/*
+ * Traffic capture file (meas_rs232_capture()): MEAS_RS232_CAPTURE_MAGIC (8 bytes)
+ * followed by records of
+ *   8 bytes   time stamp (ns, CLOCK_MONOTONIC; little endian)
+ *   1 byte    direction (MEAS_RS232_CAPTURE_TX or MEAS_RS232_CAPTURE_RX)
+ *   4 bytes   data length (little endian)
+ *   data
+ */
+#define MEAS_RS232_CAPTURE_MAGIC "MEASCAP1"
+#define MEAS_RS232_CAPTURE_TX 0
+#define MEAS_RS232_CAPTURE_RX 1
+
+/* Number of bins in the log2 latency histograms (bin i: 2^i - 2^(i+1) us) */
+#define MEAS_RS232_HIST_BINS 24
+
+/* RS232 port statistics (meas_rs232_stats()) */
+struct meas_rs232_stats {
+  long bytes_in, bytes_out;                    /* bytes received / sent */
+  long reads, writes;                          /* read/write system calls */
+  long would_block;                            /* reads that had to wait for data */
+  long first_byte[MEAS_RS232_HIST_BINS];       /* request to first byte latency */
+  long terminator[MEAS_RS232_HIST_BINS];       /* request to reply terminator latency */
+};
+
+/* Maximum payload length of a reply frame */
+#define MEAS_RS232_FRAME_MAX 256
+
+/* Reply frame specification (meas_rs232_frame_read()) */
+struct meas_rs232_frame {
+  int echo;       /* echo byte (-1 = none) */
+  int npayload;   /* number of payload bytes */
+  int status;     /* 1 = status byte after payload, 0 = none */
+  int eot;        /* terminator byte (-1 = none) */
+};
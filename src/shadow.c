@@ -0,0 +1,171 @@
+/*
+ * Shadow cache of instrument settings.
+ *
+ * Experiment code often sends the same settings again on every scan point
+ * although only one of them changed. The drivers remember the last command
+ * sent for each setting (key, e.g. SCPI header ":PULSE2:DELAY") and skip
+ * commands that would not change anything:
+ *
+ *   if(meas_shadow_update(cache, cmd, keylen))
+ *     if(write(cmd) < 0) meas_shadow_forget(cache, cmd, keylen);
+ *
+ * If the instrument is changed behind the driver's back (front panel,
+ * reset, another program), the cache must be invalidated (see the
+ * *_invalidate() function of the driver). Setting environment variable
+ * MEAS_SHADOW_OFF disables the cache.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shadow.h"
+#include "misc.h"
+
+struct shadow {
+  int used;
+  int n;                                                  /* number of entries */
+  char cmd[MEAS_SHADOW_ENTRIES][MEAS_SHADOW_CMDLEN];      /* last command for each key */
+  int keylen[MEAS_SHADOW_ENTRIES];
+};
+
+static struct shadow shadows[MEAS_SHADOW_MAX];
+static int off = -1;
+
+/* Entry with the key of cmd (-1 = none) */
+static int shadow_find(struct shadow *s, char *cmd, int keylen) {
+
+  int i;
+
+  for(i = 0; i < s->n; i++)
+    if(s->keylen[i] == keylen && !strncmp(s->cmd[i], cmd, keylen)) return i;
+  return -1;
+}
+
+/*
+ * Allocate a cache (for one instrument).
+ *
+ * Returns cache descriptor.
+ *
+ */
+
+EXPORT int meas_shadow_open() {
+
+  int i;
+
+  if(off == -1) off = getenv(MEAS_SHADOW_ENV_OFF)?1:0;
+  for(i = 0; i < MEAS_SHADOW_MAX; i++)
+    if(!shadows[i].used) {
+      shadows[i].used = 1;
+      shadows[i].n = 0;
+      return i;
+    }
+  meas_err("meas_shadow_open: Too many caches (increase MEAS_SHADOW_MAX).");
+}
+
+/*
+ * Release a cache.
+ *
+ * c = Cache descriptor.
+ *
+ */
+
+EXPORT int meas_shadow_close(int c) {
+
+  if(c < 0 || c >= MEAS_SHADOW_MAX) meas_err("meas_shadow_close: Illegal cache.");
+  shadows[c].used = 0;
+  return 0;
+}
+
+/*
+ * Check whether a command has to be sent and remember it.
+ *
+ * c      = Cache descriptor.
+ * cmd    = Command.
+ * keylen = Length of the part of cmd that identifies the setting
+ *          (e.g. strcspn(cmd, " ") for SCPI).
+ *
+ * Returns 1 if the command must be sent (setting unknown or different)
+ * or 0 if the instrument already has this setting.
+ *
+ */
+
+EXPORT int meas_shadow_update(int c, char *cmd, int keylen) {
+
+  struct shadow *s;
+  int i;
+
+  if(c < 0 || c >= MEAS_SHADOW_MAX || !shadows[c].used) return 1;
+  if(off || strlen(cmd) >= MEAS_SHADOW_CMDLEN) return 1;
+  s = &shadows[c];
+  if((i = shadow_find(s, cmd, keylen)) >= 0) {
+    if(!strcmp(s->cmd[i], cmd)) return 0;
+  } else {
+    if(s->n == MEAS_SHADOW_ENTRIES) return 1;  /* full: just send */
+    i = s->n++;
+    s->keylen[i] = keylen;
+  }
+  strcpy(s->cmd[i], cmd);
+  return 1;
+}
+
+/*
+ * Check whether the instrument already has a setting (the cache is not
+ * changed).
+ *
+ * c      = Cache descriptor.
+ * cmd    = Command.
+ * keylen = Key length.
+ *
+ * Returns 1 if cmd was the last command sent for its key, 0 otherwise.
+ *
+ */
+
+EXPORT int meas_shadow_has(int c, char *cmd, int keylen) {
+
+  struct shadow *s;
+  int i;
+
+  if(c < 0 || c >= MEAS_SHADOW_MAX || !shadows[c].used || off) return 0;
+  s = &shadows[c];
+  return (i = shadow_find(s, cmd, keylen)) >= 0 && !strcmp(s->cmd[i], cmd);
+}
+
+/*
+ * Forget one setting (e.g. after the command failed).
+ *
+ * c      = Cache descriptor.
+ * cmd    = Command (only the key is used).
+ * keylen = Key length.
+ *
+ */
+
+EXPORT int meas_shadow_forget(int c, char *cmd, int keylen) {
+
+  struct shadow *s;
+  int i;
+
+  if(c < 0 || c >= MEAS_SHADOW_MAX || !shadows[c].used) return 0;
+  s = &shadows[c];
+  if((i = shadow_find(s, cmd, keylen)) < 0) return 0;
+  s->n--;
+  if(i != s->n) {
+    strcpy(s->cmd[i], s->cmd[s->n]);
+    s->keylen[i] = s->keylen[s->n];
+  }
+  return 0;
+}
+
+/*
+ * Forget all settings (instrument state unknown).
+ *
+ * c = Cache descriptor.
+ *
+ */
+
+EXPORT int meas_shadow_invalidate(int c) {
+
+  if(c < 0 || c >= MEAS_SHADOW_MAX) meas_err("meas_shadow_invalidate: Illegal cache.");
+  shadows[c].n = 0;
+  return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * Instrument setting shadow cache.
+ *
+ */
+
+/* Maximum number of caches (one per instrument) */
+#define MEAS_SHADOW_MAX 64
+
+/* Settings remembered per instrument */
+#define MEAS_SHADOW_ENTRIES 64
+
+/* Maximum length of a remembered command */
+#define MEAS_SHADOW_CMDLEN 128
+
+/* Set this environment variable to send every setting (cache off) */
+#define MEAS_SHADOW_ENV_OFF "MEAS_SHADOW_OFF"
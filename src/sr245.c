@@ -4,21 +4,21 @@
  *
  */
 
-#ifdef GPIB
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include "misc.h"
 #include "sr245.h"
 #include "serial.h"
-#include "gpib.h"
+#include "transport.h"
 
-/* Up to 5 units supported */
+/* Up to 5 units supported (transport descriptors) */
 static int sr245_fd[5] = {-1, -1, -1, -1, -1};
 static int trig_mode[5] = {0, 0, 0, 0, 0};
-static int srmode[5] = {0, 0, 0, 0, 0};
+
+static char *sync_cmds[] = {"MS", "T1", "ET", "DT"};
 
 /* 
  * Initialize the DAC interface.
@@ -35,19 +35,35 @@ static int srmode[5] = {0, 0, 0, 0, 0};
 
 EXPORT int meas_sr245_open(int unit, int board, int dev, char *serial) {
 
+  int t;
+
   if(unit < 0 || unit > 4)
     meas_err("meas_sr245_init: Illegal units number.");
+  if(sr245_fd[unit] != -1) return 0;
   if(serial) {
-    if(sr245_fd[unit] == -1)
-      sr245_fd[unit] = meas_rs232_open(serial, 1);
-    srmode[unit] = 1;
+    if((t = meas_transport_rs232(serial, MEAS_B9600)) < 0) return -1;
   } else {
-    if(sr245_fd[unit] == -1) {
-      sr245_fd[unit] = meas_gpib_open(board, dev); 
-      meas_gpib_timeout(sr245_fd[unit], 1.0);
-    }
-    srmode[unit] = 0;
+    if((t = meas_transport_gpib(board, dev, MEAS_SR245_TERM)) < 0) return -1;
+    meas_transport_timeout(t, 1.0);
   }
+  return meas_sr245_open_transport(unit, t);
+}
+
+/*
+ * Initialize the interface on an open transport (see transport.c).
+ *
+ * unit = unit number (0 - 4)
+ * t    = transport descriptor (GPIB, RS232 or TCP).
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr245_open_transport(int unit, int t) {
+
+  if(unit < 0 || unit > 4)
+    meas_err("meas_sr245_open_transport: Illegal units number.");
+  sr245_fd[unit] = t;
   return 0;
 }
 
@@ -64,10 +80,7 @@ EXPORT int meas_sr245_disable_trigger(int unit) {
 
   if(sr245_fd[unit] == -1) 
     meas_err("meas_sr245_disable_trigger: Non-existent unit.");
-  if(srmode[unit]) 
-    meas_rs232_write(sr245_fd[unit], "DT\r", 3);
-  else
-    meas_gpib_write(sr245_fd[unit], "DT", MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], "DT");
   return 0;
 }
 
@@ -84,10 +97,7 @@ EXPORT int meas_sr245_enable_trigger(int unit) {
 
   if(sr245_fd[unit] == -1)
     meas_err("meas_sr245_enable_trigger: Non-existent unit.");
-  if(srmode[unit]) 
-    meas_rs232_write(sr245_fd[unit], "ET\r", 3);
-  else
-    meas_gpib_write(sr245_fd[unit], "ET", MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], "ET");
   return 0;
 }
 
@@ -105,28 +115,12 @@ EXPORT int meas_sr245_mode(int unit, int mode) {
 
   if(sr245_fd[unit] == -1)
     meas_err("meas_sr245_mode: Non-existent unit.");
-  if(srmode[unit]) {
-    if(mode) {
-      meas_rs232_write(sr245_fd[unit], "MS\r", 3);
-      meas_rs232_write(sr245_fd[unit], "T1\r", 3);
-      meas_rs232_write(sr245_fd[unit], "ET\r", 3);
-      meas_rs232_write(sr245_fd[unit], "DT\r", 3);
-      trig_mode[unit] = 1;
-    } else {
-      meas_rs232_write(sr245_fd[unit], "MA\r", 3);
-      trig_mode[unit] = 0;
-    }
+  if(mode) {
+    meas_transport_writev(sr245_fd[unit], sync_cmds, 4);
+    trig_mode[unit] = 1;
   } else {
-    if(mode) {
-      meas_gpib_write(sr245_fd[unit], "MS", MEAS_SR245_TERM);
-      meas_gpib_write(sr245_fd[unit], "T1", MEAS_SR245_TERM);
-      meas_gpib_write(sr245_fd[unit], "ET", MEAS_SR245_TERM);
-      meas_gpib_write(sr245_fd[unit], "DT", MEAS_SR245_TERM);
-      trig_mode[unit] = 1;
-    } else {
-      meas_gpib_write(sr245_fd[unit], "MA", MEAS_SR245_TERM);
-      trig_mode[unit] = 0;
-    }
+    meas_transport_write(sr245_fd[unit], "MA");
+    trig_mode[unit] = 0;
   }
   return 0;
 }
@@ -149,11 +143,7 @@ EXPORT int meas_sr245_ports(int unit, int n) {
     meas_err("meas_sr245_ports: Non-existent unit.");
 
   sprintf(buf, "I%d", n);
-  if(srmode[unit]) {
-    strcat (buf, "\r");
-    meas_rs232_write(sr245_fd[unit], buf, 3);
-  } else
-    meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], buf);
   return 0;
 }
 
@@ -170,30 +160,23 @@ EXPORT int meas_sr245_ports(int unit, int n) {
 
 EXPORT double meas_sr245_read(int unit, int port) {
 
-  char buf[512];
+  char buf[MEAS_TRANSPORT_BUF_SIZE], *cmds[2];
   double val;
 
   if(sr245_fd[unit] == -1)
     meas_err("meas_sr245_read: Non-existent unit.");
 
   meas_misc_disable_signals();
-  if(srmode[unit]) {
-    if(trig_mode[unit])
-      meas_rs232_write(sr245_fd[unit], "ET\r", 3); /* now we accept triggers */
-    sprintf(buf, "?%d\r", port);
-    meas_rs232_write(sr245_fd[unit], buf, 3);
-    meas_rs232_readnl(sr245_fd[unit], buf);
-    if(trig_mode[unit]) 
-      meas_rs232_write(sr245_fd[unit], "DT\r", 3); /* disable triggers */
-  } else {
-    if(trig_mode[unit])
-      meas_gpib_write(sr245_fd[unit], "ET", MEAS_SR245_TERM); /* now we accept triggers */
-    sprintf(buf, "?%d", port);
-    meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
-    meas_gpib_read(sr245_fd[unit], buf);
-    if(trig_mode[unit]) 
-      meas_gpib_write(sr245_fd[unit], "DT", MEAS_SR245_TERM); /* disable triggers */
-  }
+  sprintf(buf, "?%d", port);
+  cmds[0] = "ET";  /* now we accept triggers */
+  cmds[1] = buf;
+  if(trig_mode[unit])
+    meas_transport_writev(sr245_fd[unit], cmds, 2);
+  else
+    meas_transport_write(sr245_fd[unit], buf);
+  meas_transport_read(sr245_fd[unit], buf, sizeof(buf));
+  if(trig_mode[unit])
+    meas_transport_write(sr245_fd[unit], "DT"); /* disable triggers */
   meas_misc_enable_signals();
 
   sscanf(buf, "%lf", &val);
@@ -218,12 +201,7 @@ EXPORT int meas_sr245_write(int unit, int port, double val) {
   if(sr245_fd[unit] == -1) 
     meas_err("meas_sr245_write: Non-existent unit.");
   sprintf(buf, "S%d=%lf", port, val);
-
-  if(srmode[unit]) {
-    strcat(buf, "\r");
-    meas_rs232_write(sr245_fd[unit], buf, strlen(buf));
-  } else
-    meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], buf);
   return 0;
 }
 
@@ -249,12 +227,7 @@ EXPORT int meas_sr245_ttl_mode(int unit, int port, int mode) {
     sprintf(buf, "SB%d=0", port);
   else /* input */
     sprintf(buf, "SB%d=I", port);
-
-  if(srmode[unit]) {
-    strcat(buf, "\r");
-    meas_rs232_write(sr245_fd[unit], buf, strlen(buf));
-  } else 
-    meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], buf);
   return 0;
 }
 
@@ -278,14 +251,7 @@ EXPORT int meas_sr245_ttl_read(int unit, int port) {
 
   meas_misc_disable_signals();
   sprintf(buf, "?B%d", port);
-  if(srmode[unit]) {
-    strcat(buf, "\r");
-    meas_rs232_write(sr245_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr245_fd[unit], buf);  
-  } else {
-    meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
-    meas_gpib_read(sr245_fd[unit], buf);
-  }
+  meas_transport_query(sr245_fd[unit], buf, buf, sizeof(buf));
   meas_misc_enable_signals();
 
   sscanf(buf, "%d", &val);
@@ -311,10 +277,7 @@ EXPORT int meas_sr245_ttl_write(int unit, int port, int val) {
     meas_err("meas_sr245_ttl_write: Non-existent unit.");
 
   sprintf(buf, "SB%d=%d", port, (val?1:0));
-  if(srmode[unit]) {
-    strcat(buf, "\r");
-    meas_rs232_write(sr245_fd[unit], buf, strlen(buf));
-  } else meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], buf);
   return 0;
 }
 
@@ -358,78 +321,216 @@ EXPORT int meas_sr245_reset(int unit) {
 
   if(sr245_fd[unit] == -1)
     meas_err("meas_sr245_reset: Non-existent unit.");
-  if(srmode[unit])
-    meas_rs232_write(sr245_fd[unit], "MR\r", 3);
-  else
-    meas_gpib_write(sr245_fd[unit], "MR", MEAS_SR245_TERM);
+  meas_transport_write(sr245_fd[unit], "MR");
   sleep(2);
   return 0;
 }
 
+/* Build the port list of a scan command (e.g. "SS1,2,3"). */
+static int scan_cmd(char *buf, char *cmd, int *ports, int nports) {
+
+  int i;
+
+  if(nports < 1 || nports > 8) return -1;
+  buf += sprintf(buf, "%s", cmd);
+  for (i = 0; i < nports; i++)
+    buf += sprintf(buf, (i ? ",%d" : "%d"), ports[i]);
+  return 0;
+}
+
+/*
+ * Convert scan samples to Volts. Each sample is two bytes, MSB first,
+ * holding a 13 bit two's complement value in units of 2.5 mV.
+ *
+ */
+
+static void scan_decode(unsigned char *raw, double *vals, int n) {
+
+  int i, v;
+
+  for (i = 0; i < n; i++, raw += 2) {
+    v = ((raw[0] & 0x1f) << 8) | raw[1];
+    if(v & 0x1000) v -= 0x2000;
+    vals[i] = v * 0.0025;
+  }
+}
+
+/* Seconds since t0 */
+static double elapsed(struct timespec *t0) {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) (now.tv_sec - t0->tv_sec) + 1E-9 * (double) (now.tv_nsec - t0->tv_nsec);
+}
+
+/*
+ * Read scan data from the SR245 and pass it to chunk() in pieces of step
+ * to max samples (max a multiple of step). npoints < 0 reads until chunk()
+ * returns non-zero.
+ *
+ * The reads start with one step and are then sized from the observed
+ * sample rate to take about MEAS_SR245_SCAN_LATENCY (at most a quarter of
+ * the transport timeout), so that slow triggers do not time out a read.
+ *
+ * Returns 0 when all data was read, 1 if chunk() stopped the scan and -1
+ * on error (including timeouts; nothing is decoded then).
+ *
+ */
+
+static int scan_stream(int unit, int npoints, int step, int max, int (*chunk)(double *, int, int, void *), void *arg) {
+
+  unsigned char raw[2 * MEAS_SR245_SCAN_CHUNK];
+  double vals[MEAS_SR245_SCAN_CHUNK], tmo, target = MEAS_SR245_SCAN_LATENCY, dt;
+  struct timespec t0;
+  int n, err, offset = 0, rv, piece = step;
+
+  meas_transport_get_timeout(sr245_fd[unit], &tmo);
+  if(tmo > 0.0 && tmo / 4.0 < target) target = tmo / 4.0;
+  while(npoints < 0 || offset < npoints) {
+    n = (npoints < 0 || npoints - offset > piece) ? piece : (npoints - offset);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    /* signals are blocked only during the transfer so that long scans can be interrupted */
+    meas_misc_disable_signals();
+    err = meas_transport_read_n(sr245_fd[unit], (char *) raw, 2 * n);
+    meas_misc_enable_signals();
+    if(err < 0) return -1;
+    dt = elapsed(&t0);
+    if(dt * max <= target * n) piece = max;
+    else if((piece = ((int) (target * n / dt) / step) * step) < step) piece = step;
+    scan_decode(raw, vals, n);
+    if((rv = (*chunk)(vals, n, offset, arg)) < 0) return -1;
+    if(rv > 0) return 1;
+    offset += n;
+  }
+  return 0;
+}
+
+/* End scan and discard samples still in transit. */
+static void scan_stop(int unit, int flush) {
+
+  meas_misc_disable_signals();
+  meas_transport_write(sr245_fd[unit], "ES");
+  if(flush) meas_transport_flush(sr245_fd[unit]);
+  meas_misc_enable_signals();
+}
+
+/*
+ * Scan mode with streaming readout (no limit on the number of points).
+ *
+ * Each trigger makes the SR245 sample the listed ports in order, so
+ * sample i of the scan comes from port ports[i % nports]. The binary data
+ * is read in chunks of up to MEAS_SR245_SCAN_CHUNK samples, converted to
+ * Volts and passed to the chunk function. The chunks follow the trigger
+ * rate (see MEAS_SR245_SCAN_LATENCY).
+ *
+ * unit    = SR245 unit number
+ * ports   = an array of port numbers to be scanned
+ * nports  = number of ports in ports array (1 - 8)
+ * npoints = total number of points to read
+ * chunk   = Function called as chunk(vals, n, offset, arg) for every chunk
+ *           (vals = n values in Volts, offset = position in the scan).
+ *           Return 0 to continue, non-zero to stop the scan (< 0 = error).
+ * arg     = Passed to the chunk function.
+ *
+ * Returns zero on success (also when chunk stopped the scan) and -1 on
+ * error, e.g. when no trigger comes within the transport timeout.
+ *
+ */
+
+EXPORT int meas_sr245_scan_stream(int unit, int *ports, int nports, int npoints, int (*chunk)(double *, int, int, void *), void *arg) {
+
+  char buf[128], *cmds[2];
+  int rv;
+
+  if(sr245_fd[unit] == -1)
+    meas_err("meas_sr245_scan_stream: Non-existent unit.");
+  if(!trig_mode[unit]) meas_err("meas_sr245_scan_stream: Only triggered mode allowed.");
+  if(npoints < 1) meas_err("meas_sr245_scan_stream: Illegal number of points.");
+  if(scan_cmd(buf, "SS", ports, nports) < 0) meas_err("meas_sr245_scan_stream: Illegal number of ports.");
+  sprintf(buf + strlen(buf), ":%d", npoints);
+
+  meas_misc_disable_signals();
+  meas_transport_write(sr245_fd[unit], "ES");
+  cmds[0] = buf;
+  cmds[1] = "ET";
+  meas_transport_writev(sr245_fd[unit], cmds, 2);
+  meas_misc_enable_signals();
+  rv = scan_stream(unit, npoints, nports, (MEAS_SR245_SCAN_CHUNK / nports) * nports, chunk, arg);
+  scan_stop(unit, rv != 0);
+  if(rv < 0) meas_err("meas_sr245_scan_stream: Scan failed.");
+  return 0;
+}
+
+/* Chunk function for meas_sr245_scan_read(). */
+static int scan_copy(double *vals, int n, int offset, void *arg) {
+
+  memcpy((double *) arg + offset, vals, sizeof(double) * n);
+  return 0;
+}
+
 /*
  * Scan mode.
  *
  * unit    = SR245 unit number
  * ports   = an array of port numbers to be scanned
- * nports  = number of ports in ports array
- * points  = an array of data points read
+ * nports  = number of ports in ports array (1 - 8)
+ * points  = an array of data points read (in Volts)
  * npoints = number of points in points array
  *
  * Returns zero on success.
  *
- * (NOTE: NOT TESTED) 
+ * See meas_sr245_scan_stream().
  *
  */
 
 EXPORT int meas_sr245_scan_read(int unit, int *ports, int nports, double *points, int npoints) {
 
-  char buf[512], buf3[128];
-  unsigned char buf2[65535];
-  int i, j, sign;
+  return meas_sr245_scan_stream(unit, ports, nports, npoints, scan_copy, (void *) points);
+}
+
+/*
+ * Continuous scan mode (SC). The SR245 scans the ports on every trigger
+ * and sends the data as it goes, so it can run at its full trigger rate.
+ *
+ * unit   = SR245 unit number
+ * ports  = an array of port numbers to be scanned
+ * nports = number of ports in ports array (1 - 8)
+ * scans  = maximum number of complete scans passed to chunk at a time
+ *          (limited to MEAS_SR245_SCAN_CHUNK samples; fewer at slow
+ *          trigger rates, see MEAS_SR245_SCAN_LATENCY)
+ * chunk  = Function called as chunk(vals, n, offset, arg) for each group
+ *          of scans (see meas_sr245_scan_stream()). Return non-zero to
+ *          stop (< 0 = error).
+ * arg    = Passed to the chunk function.
+ *
+ * Returns zero when chunk stopped the acquisition, -1 on error.
+ *
+ */
+
+EXPORT int meas_sr245_scan_continuous(int unit, int *ports, int nports, int scans, int (*chunk)(double *, int, int, void *), void *arg) {
+
+  char buf[128], *cmds[3];
+  int per;
 
   if(sr245_fd[unit] == -1)
-    meas_err("meas_sr245_scan_read: Non-existent unit.");
+    meas_err("meas_sr245_scan_continuous: Non-existent unit.");
+  if(!trig_mode[unit]) meas_err("meas_sr245_scan_continuous: Only triggered mode allowed.");
+  if(scan_cmd(buf, "SC", ports, nports) < 0) meas_err("meas_sr245_scan_continuous: Illegal number of ports.");
+  if(scans < 1) scans = 1;
+  per = nports * scans;
+  if(per > MEAS_SR245_SCAN_CHUNK) per = (MEAS_SR245_SCAN_CHUNK / nports) * nports;
 
   meas_misc_disable_signals();
-  /* Alternative way would be to use SC - would allow for higher throughput */
-  if(!trig_mode[unit]) meas_err("meas_sr245_scan_read: Only triggered mode allowed.");
-  if(npoints * 2 > 65535) meas_err("meas_sr245_scan_read: Too many samples.");
-  if(srmode[unit]) 
-    meas_rs232_write(sr245_fd[unit], "ES\r", 3);
-  else
-    meas_gpib_write(sr245_fd[unit], "ES", MEAS_SR245_TERM);
-  sprintf(buf, "SS");
-  for (i = 0; ; i++) {
-    sprintf(buf3, "%d", ports[i]);
-    strcat(buf, buf3);
-    if (i == nports) break;
-    strcat(buf, ",");
-  }
-  sprintf(buf3, ":%d", npoints);
-  strcat(buf, buf3);
-
-  if(srmode[unit]) {
-    strcat(buf, "\r");
-    meas_rs232_write(sr245_fd[unit], buf, strlen(buf));
-    meas_rs232_write(sr245_fd[unit], "ET\r", 3);
-    meas_rs232_read(sr245_fd[unit], (char *) buf2, 2 * npoints);
-    meas_rs232_write(sr245_fd[unit], "ES\r", 3);
-  } else {
-    meas_gpib_write(sr245_fd[unit], buf, MEAS_SR245_TERM);
-    meas_gpib_write(sr245_fd[unit], "ET", MEAS_SR245_TERM);
-    meas_gpib_read_n(sr245_fd[unit], (char *) buf2, 2 * npoints);
-    meas_gpib_write(sr245_fd[unit], "ES", MEAS_SR245_TERM);
-  }
+  cmds[0] = "ES";
+  cmds[1] = buf;
+  cmds[2] = "ET";
+  meas_transport_writev(sr245_fd[unit], cmds, 3);
   meas_misc_enable_signals();
-
-  /* reconstruct data */
-  for (i = j = 0; i < 2*npoints; i += 2, j++) {
-    sign = buf2[i] & 0x10;
-    if(sign) sign = -1;
-    else sign = 0;
-    points[j] = sign * ((buf2[i] & 0x0f) * 256 + buf2[i+1]) * 0.0025; /* to volts */
+  if(scan_stream(unit, -1, nports, per, chunk, arg) < 0) {
+    scan_stop(unit, 1);
+    meas_err("meas_sr245_scan_continuous: Scan failed.");
   }
+  scan_stop(unit, 1);
   return 0;
 }
-
-#endif /* GPIB */
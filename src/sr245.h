@@ -1,2 +1,8 @@
 /* line terminator (1 = CR LF, 0 = CR) */
 #define MEAS_SR245_TERM 1
+
+/* Samples read from the SR245 at a time in scan mode */
+#define MEAS_SR245_SCAN_CHUNK 1024
+
+/* Scan mode reads are sized to take about this long at the trigger rate (s) */
+#define MEAS_SR245_SCAN_LATENCY 0.1
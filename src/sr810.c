@@ -5,20 +5,18 @@
  *
  */
 
-#ifdef GPIB
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include "misc.h"
 #include "sr810.h"
 #include "serial.h"
-#include "gpib.h"
+#include "transport.h"
 
-/* Up to 5 units supported */
+/* Up to 5 units supported (transport descriptors) */
 static int sr810_fd[5] = {-1, -1, -1, -1, -1};
-static int srmode[5] = {0, 0, 0, 0, 0};
 
 /* 
  * Initialize the instrument.
@@ -35,20 +33,37 @@ static int srmode[5] = {0, 0, 0, 0, 0};
 
 EXPORT int meas_sr810_open(int unit, int board, int dev, char *serial) {
 
+  int t;
+
   if(unit < 0 || unit > 4)
     meas_err("meas_sr810_init: Illegal units number.");
+  if(sr810_fd[unit] != -1) return 0;
   if(serial) {
-    if(sr810_fd[unit] == -1)
-      sr810_fd[unit] = meas_rs232_open(serial, 1);
-    srmode[unit] = 1;
+    if((t = meas_transport_rs232(serial, MEAS_B9600)) < 0) return -1;
   } else {
-    if(sr810_fd[unit] == -1) {
-      sr810_fd[unit] = meas_gpib_open(board, dev); 
-      meas_gpib_timeout(sr810_fd[unit], 1.0);
-    }
-    srmode[unit] = 0;
+    if((t = meas_transport_gpib(board, dev, MEAS_SR810_TERM)) < 0) return -1;
+    meas_transport_timeout(t, 1.0);
   }
-  return 0;
+  return meas_sr810_open_transport(unit, t);
+}
+
+/*
+ * Initialize the instrument on an open transport (see transport.c).
+ * The replies are directed to the interface in use (OUTX).
+ *
+ * unit = unit number (0 - 4)
+ * t    = transport descriptor (GPIB, RS232 or TCP to a serial adapter).
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_open_transport(int unit, int t) {
+
+  if(unit < 0 || unit > 4)
+    meas_err("meas_sr810_open_transport: Illegal units number.");
+  sr810_fd[unit] = t;
+  return meas_transport_write(t, (meas_transport_type(t) == MEAS_TRANSPORT_GPIB)?"OUTX 1":"OUTX 0");
 }
 
 /*
@@ -68,11 +83,7 @@ EXPORT int meas_sr810_set_refphase(int unit, double phase) {
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_set_refphase: Non-existent unit.");
   sprintf(buf, "PHAS %le", phase);
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-  } else /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
+  meas_transport_write(sr810_fd[unit], buf);
 
   return 0;
 }
@@ -92,15 +103,7 @@ EXPORT double meas_sr810_get_refphase(int unit) {
 
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_get_refphase: Non-existent unit.");
-  sprintf(buf, "PHAS?");
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr810_fd[unit], buf);
-  } else { /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
-    meas_gpib_read(sr810_fd[unit], buf);
-  }
+  meas_transport_query(sr810_fd[unit], "PHAS?", buf, sizeof(buf));
 
   return atof(buf);
 }
@@ -125,11 +128,7 @@ EXPORT int meas_sr810_set_refsource(int unit, int source) {
   if(source < MEAS_SR810_REF_SOURCE_EXT || MEAS_SR810_REF_SOURCE_INT > 1)
     meas_err("meas_sr810_set_refsource: Illegal reference source.");
   sprintf(buf, "FMOD %d", (source==MEAS_SR810_REF_SOURCE_INT)?1:0);
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-  } else /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
+  meas_transport_write(sr810_fd[unit], buf);
 
   return 0;
 }
@@ -150,15 +149,7 @@ EXPORT double meas_sr810_get_refsource(int unit) {
 
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_get_refsource: Non-existent unit.");
-  sprintf(buf, "FMOD?");
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr810_fd[unit], buf);
-  } else { /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
-    meas_gpib_read(sr810_fd[unit], buf);
-  }
+  meas_transport_query(sr810_fd[unit], "FMOD?", buf, sizeof(buf));
 
   return (atoi(buf)==1)?MEAS_SR810_REF_SOURCE_INT:MEAS_SR810_REF_SOURCE_EXT;
 }
@@ -184,11 +175,7 @@ EXPORT int meas_sr810_set_reffreq(int unit, double freq) {
   if(meas_sr810_get_refsource(unit) == MEAS_SR810_REF_SOURCE_EXT)
     meas_err("meas_sr810_set_reffreq: Frequency set when in external reference mode.");
   sprintf(buf, "FREQ %le", freq);
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-  } else /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
+  meas_transport_write(sr810_fd[unit], buf);
 
   return 0;
 }
@@ -208,15 +195,7 @@ EXPORT double meas_sr810_get_reffreq(int unit) {
 
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_get_reffreq: Non-existent unit.");
-  sprintf(buf, "FREQ?");
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr810_fd[unit], buf);
-  } else { /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
-    meas_gpib_read(sr810_fd[unit], buf);
-  }
+  meas_transport_query(sr810_fd[unit], "FREQ?", buf, sizeof(buf));
 
   return atof(buf);
 }
@@ -239,7 +218,7 @@ EXPORT int meas_sr810_set_reftrig(int unit, int trig) {
 
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_set_reftrig: Non-existent unit.");
-  if(trig < MEAS_SR810_REF_MODE_SCZ || trig > MEAS_SR810_REF_MODE_FE) 
+  if(trig < MEAS_SR810_REF_MODE_SZC || trig > MEAS_SR810_REF_MODE_FE) 
     meas_err("meas_sr810_set_reftrig: Illegal reference trigger setting.");
   if(meas_sr810_get_refsource(unit) == MEAS_SR810_REF_SOURCE_EXT)
     meas_err("meas_sr810_set_reftrig: Trigger set when in external reference mode.");
@@ -254,11 +233,7 @@ EXPORT int meas_sr810_set_reftrig(int unit, int trig) {
     sprintf(buf, "RSLP 2");
     break;
   }
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-  } else /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
+  meas_transport_write(sr810_fd[unit], buf);
 
   return 0;
 }
@@ -281,15 +256,7 @@ EXPORT int meas_sr810_get_reftrig(int unit) {
 
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_get_reftrig: Non-existent unit.");
-  sprintf(buf, "RSLP?");
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr810_fd[unit], buf);
-  } else { /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
-    meas_gpib_read(sr810_fd[unit], buf);
-  }
+  meas_transport_query(sr810_fd[unit], "RSLP?", buf, sizeof(buf));
 
   switch (atoi(buf)) {
   case 0:
@@ -322,11 +289,7 @@ EXPORT int meas_sr810_set_harmonic(int unit, int harm) {
   if(harm < 1 || harm > 19999) 
     meas_err("meas_sr810_set_harmonic: Illegal harmonic setting.");
   sprintf(buf, "HARM %d", harm);
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-  } else /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
+  meas_transport_write(sr810_fd[unit], buf);
 
   return 0;
 }
@@ -346,15 +309,7 @@ EXPORT int meas_sr810_get_harmonic(int unit) {
 
   if(sr810_fd[unit] == -1)
     meas_err("meas_sr810_get_harmonic: Non-existent unit.");
-  sprintf(buf, "HARM?");
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr810_fd[unit], buf);
-  } else { /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
-    meas_gpib_read(sr810_fd[unit], buf);
-  }
+  meas_transport_query(sr810_fd[unit], "HARM?", buf, sizeof(buf));
 
   return atoi(buf);
 }
@@ -378,11 +333,7 @@ EXPORT int meas_sr810_set_sinelevel(int unit, double level) {
   if(level < 0.004 || level > 5.000) 
     meas_err("meas_sr810_set_sinelevel: Illegal sine output voltage setting.");
   sprintf(buf, "SLVL %le", level);
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-  } else /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
+  meas_transport_write(sr810_fd[unit], buf);
 
   return 0;
 }
@@ -402,17 +353,203 @@ EXPORT double meas_sr810_get_sinelevel(int unit) {
 
   if(sr810_fd[unit] == -1) 
     meas_err("meas_sr810_get_sinelevel: Non-existent unit.");
-  sprintf(buf, "SLVL?");
-  if(srmode[unit]) { /* RS232 */
-    strcat(buf, "\r");
-    meas_rs232_write(sr810_fd[unit], buf, strlen(buf));
-    meas_rs232_readnl(sr810_fd[unit], buf);
-  } else { /* GPIB */
-    meas_gpib_write(sr810_fd[unit], buf, MEAS_SR810_TERM);
-    meas_gpib_read(sr810_fd[unit], buf);
-  }
+  meas_transport_query(sr810_fd[unit], "SLVL?", buf, sizeof(buf));
 
   return atof(buf);
 }
 
-#endif /* GPIB */
+/*
+ * Set up the data buffer. The buffer is reset (see also
+ * meas_sr810_buffer_start()). Channel 1 display (DDEF) is stored.
+ *
+ * unit = SR810 unit number.
+ * rate = sample rate in Hz: 0.0625 * 2^n (n = 0 ... 13, i.e. up to 512 Hz)
+ *        or MEAS_SR810_RATE_TRIGGER for one point per trigger.
+ * loop = 0: stop when the buffer is full, 1: keep going (overwrite the oldest
+ *        points).
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_buffer_setup(int unit, double rate, int loop) {
+
+  char buf[2][32], *cmds[4];
+  int n;
+
+  if(sr810_fd[unit] == -1)
+    meas_err("meas_sr810_buffer_setup: Non-existent unit.");
+  if(rate == MEAS_SR810_RATE_TRIGGER) n = 14;
+  else {
+    for (n = 0; n < 14 && fabs(rate - 0.0625 * (1 << n)) > 1E-6 * rate; n++);
+    if(n == 14) meas_err("meas_sr810_buffer_setup: Illegal sample rate.");
+  }
+  sprintf(buf[0], "SRAT %d", n);
+  sprintf(buf[1], "SEND %d", loop?1:0);
+  cmds[0] = "REST";
+  cmds[1] = buf[0];
+  cmds[2] = buf[1];
+  cmds[3] = "TSTR 0";
+  return meas_transport_writev(sr810_fd[unit], cmds, 4);
+}
+
+/*
+ * Start (or resume) filling the data buffer.
+ *
+ * unit = SR810 unit number.
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_buffer_start(int unit) {
+
+  if(sr810_fd[unit] == -1)
+    meas_err("meas_sr810_buffer_start: Non-existent unit.");
+  return meas_transport_write(sr810_fd[unit], "STRT");
+}
+
+/*
+ * Pause filling the data buffer.
+ *
+ * unit = SR810 unit number.
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_buffer_pause(int unit) {
+
+  if(sr810_fd[unit] == -1)
+    meas_err("meas_sr810_buffer_pause: Non-existent unit.");
+  return meas_transport_write(sr810_fd[unit], "PAUS");
+}
+
+/*
+ * Clear the data buffer.
+ *
+ * unit = SR810 unit number.
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_buffer_reset(int unit) {
+
+  if(sr810_fd[unit] == -1)
+    meas_err("meas_sr810_buffer_reset: Non-existent unit.");
+  return meas_transport_write(sr810_fd[unit], "REST");
+}
+
+/*
+ * Number of points stored in the data buffer.
+ *
+ * unit = SR810 unit number.
+ *
+ * Returns the number of points.
+ *
+ */
+
+EXPORT int meas_sr810_buffer_points(int unit) {
+
+  char buf[512];
+
+  if(sr810_fd[unit] == -1)
+    meas_err("meas_sr810_buffer_points: Non-existent unit.");
+  if(meas_transport_query(sr810_fd[unit], "SPTS?", buf, sizeof(buf)) < 0) return -1;
+  return atoi(buf);
+}
+
+/* IEEE float, least significant byte first (TRCB?), to double on any host */
+static double float_le(unsigned char *p) {
+
+  unsigned int u;
+  float f;
+
+  u = (unsigned int) p[0] | ((unsigned int) p[1] << 8) | ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
+  memcpy(&f, &u, sizeof(f));
+  return (double) f;
+}
+
+/*
+ * Read points from the data buffer (binary transfer, TRCB?).
+ *
+ * unit   = SR810 unit number.
+ * offset = first point to read (0 = oldest).
+ * data   = storage for the points.
+ * npts   = number of points to read.
+ *
+ * The points are transferred with one TRCB? (4 bytes each). A finite
+ * transport timeout is extended by MEAS_SR810_BYTE_TIME per byte for the
+ * transfer and restored afterwards.
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_buffer_read(int unit, int offset, double *data, int npts) {
+
+  unsigned char *raw;
+  char buf[64];
+  int i, err, t = sr810_fd[unit];
+  double tmo;
+
+  if(t == -1)
+    meas_err("meas_sr810_buffer_read: Non-existent unit.");
+  if(offset < 0 || npts < 0 || offset + npts > MEAS_SR810_BUF_SIZE)
+    meas_err("meas_sr810_buffer_read: Illegal range.");
+  if(!npts) return 0;
+  if(!(raw = (unsigned char *) malloc(4 * npts)))
+    meas_err("meas_sr810_buffer_read: Out of memory.");
+  sprintf(buf, "TRCB? %d,%d", offset, npts);
+  meas_transport_get_timeout(t, &tmo);
+  meas_misc_disable_signals();
+  if(tmo > 0.0) meas_transport_timeout(t, tmo + 4 * npts * MEAS_SR810_BYTE_TIME);
+  if((err = meas_transport_write(t, buf)) == 0)
+    err = meas_transport_read_n(t, (char *) raw, 4 * npts);
+  if(tmo > 0.0) meas_transport_timeout(t, tmo);
+  meas_misc_enable_signals();
+  if(err < 0) {
+    free(raw);
+    meas_transport_flush(t);   /* drop the rest of a partial transfer */
+    meas_err("meas_sr810_buffer_read: Transfer failed.");
+  }
+  for (i = 0; i < npts; i++)
+    data[i] = float_le(raw + 4 * i);
+  free(raw);
+  return 0;
+}
+
+/*
+ * Read several parameters at the same instant (SNAP?).
+ *
+ * unit   = SR810 unit number.
+ * params = parameters to read (MEAS_SR810_SNAP_X, ...).
+ * n      = number of parameters (2 - 6).
+ * vals   = values read (in the order of params).
+ *
+ * E.g. {MEAS_SR810_SNAP_X, MEAS_SR810_SNAP_Y, MEAS_SR810_SNAP_R,
+ * MEAS_SR810_SNAP_THETA} gives X, Y, R and theta from one query.
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_sr810_snap(int unit, int *params, int n, double *vals) {
+
+  char buf[512], *p;
+  int i;
+
+  if(sr810_fd[unit] == -1)
+    meas_err("meas_sr810_snap: Non-existent unit.");
+  if(n < 2 || n > 6) meas_err("meas_sr810_snap: Illegal number of parameters.");
+  p = buf + sprintf(buf, "SNAP? ");
+  for (i = 0; i < n; i++)
+    p += sprintf(p, (i ? ",%d" : "%d"), params[i]);
+  if(meas_transport_query(sr810_fd[unit], buf, buf, sizeof(buf)) < 0) return -1;
+  for (i = 0, p = buf; i < n; i++) {
+    vals[i] = strtod(p, &p);
+    if(i < n - 1 && *p++ != ',') meas_err("meas_sr810_snap: Malformed reply.");
+  }
+  return 0;
+}
@@ -8,3 +8,24 @@
 #define MEAS_SR810_REF_MODE_SZC 0   /* Sine zero crossing */
 #define MEAS_SR810_REF_MODE_RE  1   /* Rising edge (TTL) */
 #define MEAS_SR810_REF_MODE_FE  2   /* Falling edge (TTL) */
+
+/* Data buffer sample rate for one point per trigger (SRAT 14) */
+#define MEAS_SR810_RATE_TRIGGER 0.0
+
+/* Data buffer size (points) */
+#define MEAS_SR810_BUF_SIZE 16383
+
+/* Time allowed per byte of a TRCB? transfer (s; 9600 baud RS232, 10 bits per byte) */
+#define MEAS_SR810_BYTE_TIME 1.1E-3
+
+/* Parameters for meas_sr810_snap() (SNAP?) */
+#define MEAS_SR810_SNAP_X     1
+#define MEAS_SR810_SNAP_Y     2
+#define MEAS_SR810_SNAP_R     3
+#define MEAS_SR810_SNAP_THETA 4
+#define MEAS_SR810_SNAP_AUX1  5
+#define MEAS_SR810_SNAP_AUX2  6
+#define MEAS_SR810_SNAP_AUX3  7
+#define MEAS_SR810_SNAP_AUX4  8
+#define MEAS_SR810_SNAP_FREQ  9
+#define MEAS_SR810_SNAP_CH1   10
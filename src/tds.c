@@ -1,7 +1,7 @@
 /*
  * Support tektronix TDS series oscilloscopes.
  *
- * This contains only a routine to read data off the oscillscope.
+ * This contains only routines to read data off the oscillscope.
  * There are tons of GPIB commands that it accepts, use those directly
  * to change the scope paramters.
  *
@@ -18,14 +18,65 @@
 #include "gpib.h"
 #include "misc.h"
 
-static int tds_fd[5] = {-1, -1, -1, -1, -1};
-static int data_width = -1;
+/* Waveform preamble (scaling) of one source */
+struct preamble {
+  double xincr, xzero, pt_off; /* t = xzero + xincr * (n - pt_off) */
+  double ymult, yzero, yoff;   /* V = yzero + ymult * (code - yoff) */
+};
+
+/* Transfer settings of a scope (set by meas_tds_init()) */
+struct scope {
+  int used;
+  int fd;                      /* GPIB device */
+  int width;                   /* bytes per point */
+  int points;                  /* points per frame (DATA:START ... DATA:STOP) */
+  int frames;                  /* FastFrame frames (1 = off) */
+  int nsrc;                    /* number of sources */
+  char src[MEAS_TDS_MAXSRC][16];
+  int pre_valid;               /* preambles read since the settings changed */
+  struct preamble pre[MEAS_TDS_MAXSRC];
+};
+
+static struct scope scopes[MEAS_TDS_MAXSCOPES];
+
+/* Destination of a transfer (chunk function argument) */
+struct dest {
+  struct scope *s;
+  double *data;                /* single array ... */
+  double **frames;             /* ... or one array per frame (for this source) */
+  double scale, offset;        /* V = scale * code + offset */
+};
+
+static struct scope *scope_find(int fd) {
+
+  int i;
+
+  for (i = 0; i < MEAS_TDS_MAXSCOPES; i++)
+    if(scopes[i].used && scopes[i].fd == fd) return &scopes[i];
+  return NULL;
+}
+
+static struct scope *scope_alloc(int fd) {
+
+  int i;
+
+  if(scope_find(fd)) return scope_find(fd);
+  for (i = 0; i < MEAS_TDS_MAXSCOPES; i++)
+    if(!scopes[i].used) {
+      scopes[i].used = 1;
+      scopes[i].fd = fd;
+      return &scopes[i];
+    }
+  return NULL;
+}
 
 /*
  * Initialize instrument.
  *
  * fd      = GPIB device file descriptor (int).
  * src     = Data source on the scope: "CH1", "CH2", etc., "MATH1", ... (char *)
+ *           Several sources separated by commas (e.g. "CH1,CH2") are
+ *           transferred in one CURVE? (see meas_tds_transfer_frames()).
  * length  = Data length (int). (number of points to acquire)
  * start   = Data start location (int).
  * end     = Data stop location (int).
@@ -39,11 +90,23 @@ static int data_width = -1;
 
 EXPORT int meas_tds_init(int fd, char *src, int length, int start, int end, int width) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
+  char buf[512], *p, *q;
+  struct scope *s;
+  int len;
 
   if(end < start) return -1;
   if(width != 1 && width != 2) return -1;
-  if(length*width >= MEAS_GPIB_BUF_SIZE) return -1; // Increase MEAS_GPIB_BUF_SIZE
+  if(!(s = scope_alloc(fd))) meas_err("meas_tds_init: Too many scopes.");
+  s->pre_valid = 0;
+  s->frames = 1;
+  s->points = ((end < length)?end:length) - start + 1;
+  for (s->nsrc = 0, p = src; p && *p; s->nsrc++, p = q) {
+    if(s->nsrc == MEAS_TDS_MAXSRC) meas_err("meas_tds_init: Too many sources.");
+    len = (q = strchr(p, ','))?(q++ - p):(int) strlen(p);
+    if(len >= (int) sizeof(s->src[0])) len = sizeof(s->src[0]) - 1;
+    sprintf(s->src[s->nsrc], "%.*s", len, p);
+  }
+  if(!s->nsrc) return -1;
   usleep(10000); // device gets stuck if communicated to quickly after open
   meas_gpib_set(fd, BIN); /* XEOS and REOS disabled (binary data transfer) */
   if(meas_gpib_write(fd, "DATA:ENCDG RIBINARY", MEAS_TDS_CRLF) < 0) return -1;
@@ -55,19 +118,107 @@ EXPORT int meas_tds_init(int fd, char *src, int length, int start, int end, int
   if(meas_gpib_write(fd, buf, MEAS_TDS_CRLF) < 0) return -1;
   if(width == 1) { 
     if(meas_gpib_write(fd, "DATa:WIDth 1", MEAS_TDS_CRLF) < 0) return -1;
-    data_width = 1;
+    s->width = 1;
   } else {
     if(meas_gpib_write(fd, "DATa:WIDth 2", MEAS_TDS_CRLF) < 0) return -1;
-    data_width = 2;
+    s->width = 2;
   }
   sprintf(buf, "HORIZONTAL:RECORDLENGTH %d", length);
   if(meas_gpib_write(fd, buf, MEAS_TDS_CRLF) < 0) return -1;
   return 0;
 }
 
+/*
+ * Segmented (FastFrame) acquisition: each trigger fills one frame of the
+ * record length given to meas_tds_init() and all frames are transferred
+ * as one block per source (see meas_tds_transfer_frames()).
+ *
+ * fd     = GPIB device file descriptor (initialized with meas_tds_init()).
+ * frames = number of frames (0 or 1 = FastFrame off).
+ *
+ * Return 0 for OK, -1 for error.
+ *
+ */
+
+EXPORT int meas_tds_fastframe(int fd, int frames) {
+
+  char buf[512];
+  struct scope *s;
+
+  if(!(s = scope_find(fd))) meas_err("meas_tds_fastframe: Call meas_tds_init() first.");
+  if(frames <= 1) {
+    s->frames = 1;
+    return meas_gpib_write(fd, "HORIZONTAL:FASTFRAME:STATE OFF", MEAS_TDS_CRLF);
+  }
+  sprintf(buf, "HORIZONTAL:FASTFRAME:COUNT %d", frames);
+  if(meas_gpib_write(fd, buf, MEAS_TDS_CRLF) < 0) return -1;
+  if(meas_gpib_write(fd, "HORIZONTAL:FASTFRAME:STATE ON", MEAS_TDS_CRLF) < 0) return -1;
+  sprintf(buf, "DATA:FRAMESTART 1;FRAMESTOP %d", frames);
+  if(meas_gpib_write(fd, buf, MEAS_TDS_CRLF) < 0) return -1;
+  s->frames = frames;
+  s->pre_valid = 0;
+  return 0;
+}
+
+/*
+ * Sample value of 2 byte RIBINARY data: signed, most significant byte
+ * first (independent of host byte order).
+ *
+ */
+
+#define SAMPLE2(p) ((double) (short) ((((unsigned char *) (p))[0] << 8) | ((unsigned char *) (p))[1]))
+
+/*
+ * Convert n samples to scale * code + offset. There are no branches in the
+ * loops, so that the compiler can vectorize them.
+ *
+ */
+
+static void scale_samples(double *data, signed char *p, int n, int width, double scale, double off) {
+
+  int x;
+
+  if(width == 2)
+    for(x = 0; x < n; x++) data[x] = scale * SAMPLE2(p + 2 * x) + off;
+  else
+    for(x = 0; x < n; x++) data[x] = scale * (double) p[x] + off;
+}
+
+/* Convert a chunk of curve data (chunks are a multiple of two bytes except possibly the last) */
+static int convert(char *buf, int len, int offset, void *arg) {
+
+  struct dest *d = (struct dest *) arg;
+  int w = d->s->width;
+
+  if(offset / w + len / w > d->s->points) return -1;  /* more than fits in data */
+  scale_samples(d->data + offset / w, (signed char *) buf, len / w, w, d->scale, d->offset);
+  return 0;
+}
+
+/* Convert a chunk of curve data into the frame arrays (the block holds the frames one after another) */
+static int convert_frames(char *buf, int len, int offset, void *arg) {
+
+  struct dest *d = (struct dest *) arg;
+  int w = d->s->width, points = d->s->points, k, n, m;
+
+  k = offset / w;
+  for (n = len / w; n > 0; n -= m, k += m, buf += m * w) {
+    if(k / points >= d->s->frames) return -1;
+    m = points - k % points;
+    if(m > n) m = n;
+    scale_samples(d->frames[k / points] + k % points, (signed char *) buf, m, w, d->scale, d->offset);
+  }
+  return 0;
+}
+
 /*
  * gpib_fd = GPIB device file descriptor (int).
- * data    = Storage space for data (double *).
+ * data    = Storage space for data (double *; length as given to meas_tds_init()).
+ *
+ * The curve is streamed from the scope and converted chunk by chunk, so
+ * there is no limit on the record length. The values are the raw sample
+ * codes (see meas_tds_transfer_volts()). Only for a single source without
+ * FastFrame.
  *
  * Return number of data points or -1 for error.
  *
@@ -75,31 +226,174 @@ EXPORT int meas_tds_init(int fd, char *src, int length, int start, int end, int
 
 EXPORT int meas_tds_transfer(int fd, double *data) {
 
-  char buf[MEAS_GPIB_BUF_SIZE];
-  short *buf2 = (short *) buf;
-  int x, yyy;
+  struct dest d;
+  int len;
 
+  if(!(d.s = scope_find(fd))) meas_err("meas_tds_transfer: Call meas_tds_init() first.");
+  if(d.s->nsrc > 1 || d.s->frames > 1) meas_err("meas_tds_transfer: Use meas_tds_transfer_frames() for several sources or frames.");
+  d.data = data;
+  d.scale = 1.0;
+  d.offset = 0.0;
   if(meas_gpib_write(fd, "CURVE?", MEAS_TDS_CRLF) < 0) return -1;
-  if(meas_gpib_read_n(fd, buf, 9) < 0) return -1;
-
-  if(buf[7] != '#') return -1;
-  x = buf[8] - '1' + 1;
-  if(meas_gpib_read_n(fd, buf, x) < 0) return -1;
-  buf[x] = '\0';
-  yyy = atoi(buf);
-  if(meas_gpib_read_n(fd, buf, yyy) < 0) return -1;
-
-  if(data_width == 2) {
-    if(meas_endian() == 1)
-      for(x = 0; x < yyy; x += 2) data[x/2] = (double) (buf[x] + 256 * buf[x+1]);
-    else
-      for(x = 0; x < yyy; x += 2) data[x/2] = (double) (buf[x+1] + 256 * buf[x]);
-    yyy /= 2;
+  if((len = meas_gpib_read_block(fd, NULL, NULL, convert, (void *) &d)) < 0) {
+    meas_gpib_device_clear(fd);  /* drop the rest of the curve */
+    return -1;
+  }
+  return len / d.s->width;
+}
+
+/* Read the preamble of one source (the reply fields may carry headers, e.g. ":WFMPRE:XINCR 2.0E-9") */
+static int read_preamble(int fd, struct preamble *pre) {
+
+  char buf[512], *p, *q;
+  double vals[6];
+  int i;
+
+  if(meas_gpib_write(fd, "WFMPRE:XINCR?;XZERO?;PT_OFF?;YMULT?;YZERO?;YOFF?", MEAS_TDS_CRLF) < 0) return -1;
+  if(meas_gpib_read_max(fd, buf, sizeof(buf)) < 0) return -1;
+  for (i = 0, p = buf; i < 6; i++) {
+    if(!p) meas_err("meas_tds: Short waveform preamble.");
+    if((q = strchr(p, ';'))) *q++ = 0;
+    if(strrchr(p, ' ')) p = strrchr(p, ' ') + 1;
+    vals[i] = atof(p);
+    p = q;
+  }
+  pre->xincr = vals[0];
+  pre->xzero = vals[1];
+  pre->pt_off = vals[2];
+  pre->ymult = vals[3];
+  pre->yzero = vals[4];
+  pre->yoff = vals[5];
+  return 0;
+}
+
+/* Read the preambles of all sources (WFMPRE describes the first source in DATA:SOURCE) */
+static int read_preambles(struct scope *s) {
+
+  char buf[512];
+  int i;
+
+  if(s->nsrc == 1) {
+    if(read_preamble(s->fd, &s->pre[0]) < 0) return -1;
   } else {
-    for(x = 0; x < yyy; x++)
-      data[x] = (double) buf[x];
+    for (i = 0; i < s->nsrc; i++) {
+      sprintf(buf, "DATA:SOURCE %s", s->src[i]);
+      if(meas_gpib_write(s->fd, buf, MEAS_TDS_CRLF) < 0 || read_preamble(s->fd, &s->pre[i]) < 0) return -1;
+    }
+    strcpy(buf, "DATA:SOURCE ");
+    for (i = 0; i < s->nsrc; i++)
+      sprintf(buf + strlen(buf), (i ? ",%s" : "%s"), s->src[i]);
+    if(meas_gpib_write(s->fd, buf, MEAS_TDS_CRLF) < 0) return -1;
+  }
+  s->pre_valid = 1;
+  return 0;
+}
+
+/* Fill the time axis of n points from a preamble */
+static void time_axis(struct preamble *pre, double *times, int n) {
+
+  int i;
+
+  for (i = 0; i < n; i++)
+    times[i] = pre->xzero + pre->xincr * (i - pre->pt_off);
+}
+
+/*
+ * Forget the cached waveform preamble. Call this after changing the
+ * vertical or horizontal settings of the scope directly.
+ *
+ * fd = GPIB device file descriptor.
+ *
+ */
+
+EXPORT int meas_tds_invalidate(int fd) {
+
+  struct scope *s;
+
+  if((s = scope_find(fd))) s->pre_valid = 0;
+  return 0;
+}
+
+/*
+ * Transfer the curve in Volts.
+ *
+ * fd    = GPIB device file descriptor (int).
+ * data  = Storage space for data (double *; length as given to meas_tds_init()).
+ * times = Time of each point in seconds (double *; same length) or NULL.
+ *
+ * The scaling (WFMPRE) is read from the scope on the first transfer after
+ * meas_tds_init() and cached, so repeated transfers only send CURVE?
+ * (see meas_tds_invalidate()). Only for a single source without FastFrame.
+ *
+ * Return number of data points or -1 for error.
+ *
+ */
+
+EXPORT int meas_tds_transfer_volts(int fd, double *data, double *times) {
+
+  struct dest d;
+  int len, n;
+
+  if(!(d.s = scope_find(fd))) meas_err("meas_tds_transfer_volts: Call meas_tds_init() first.");
+  if(d.s->nsrc > 1 || d.s->frames > 1) meas_err("meas_tds_transfer_volts: Use meas_tds_transfer_frames() for several sources or frames.");
+  if(!d.s->pre_valid && read_preambles(d.s) < 0) return -1;
+  d.data = data;
+  d.scale = d.s->pre[0].ymult;
+  d.offset = d.s->pre[0].yzero - d.s->pre[0].ymult * d.s->pre[0].yoff;
+  if(meas_gpib_write(fd, "CURVE?", MEAS_TDS_CRLF) < 0) return -1;
+  if((len = meas_gpib_read_block(fd, NULL, NULL, convert, (void *) &d)) < 0) {
+    meas_gpib_device_clear(fd);  /* drop the rest of the curve */
+    return -1;
+  }
+  n = len / d.s->width;
+  if(times) time_axis(&d.s->pre[0], times, n);
+  return n;
+}
+
+/*
+ * Transfer all sources (see meas_tds_init()) and FastFrame frames (see
+ * meas_tds_fastframe()) in Volts with one CURVE?. The scope sends one
+ * block per source with the frames one after another; the data is
+ * de-interleaved into one array per source and frame.
+ *
+ * fd     = GPIB device file descriptor (int).
+ * frames = Arrays for the data (double **): frames[src * nframes + frame]
+ *          holds the points of one frame (length = points per frame, i.e.
+ *          DATA:START ... DATA:STOP). src is the order in meas_tds_init().
+ * times  = Time of each point of a frame relative to its trigger (double *;
+ *          points per frame) or NULL. Taken from the first source.
+ *
+ * The scaling of each source is cached as in meas_tds_transfer_volts().
+ *
+ * Return number of points per frame or -1 for error.
+ *
+ */
+
+EXPORT int meas_tds_transfer_frames(int fd, double **frames, double *times) {
+
+  struct dest d;
+  struct scope *s;
+  int i, len;
+
+  if(!(s = scope_find(fd))) meas_err("meas_tds_transfer_frames: Call meas_tds_init() first.");
+  if(!s->pre_valid && read_preambles(s) < 0) return -1;
+  if(meas_gpib_write(fd, "CURVE?", MEAS_TDS_CRLF) < 0) return -1;
+  d.s = s;
+  for (i = 0; i < s->nsrc; i++) {
+    d.frames = frames + i * s->frames;
+    d.scale = s->pre[i].ymult;
+    d.offset = s->pre[i].yzero - s->pre[i].ymult * s->pre[i].yoff;
+    if((len = meas_gpib_read_block(fd, NULL, NULL, convert_frames, (void *) &d)) < 0) {
+      meas_gpib_device_clear(fd);  /* drop the rest of the curve */
+      return -1;
+    }
+    if(len != s->frames * s->points * s->width) {
+      meas_gpib_device_clear(fd);
+      meas_err("meas_tds_transfer_frames: Unexpected amount of data.");
+    }
   }
-  return yyy;
+  if(times) time_axis(&s->pre[0], times, s->points);
+  return s->points;
 }
 
 #endif /* GPIB */
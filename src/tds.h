@@ -1,3 +1,9 @@
 /* line termination mode (1 = CR LF, 0 = CR) */
 #define MEAS_TDS_CRLF 1
 
+
+/* Maximum number of scopes in use at the same time */
+#define MEAS_TDS_MAXSCOPES 8
+
+/* Maximum number of data sources per transfer (CH1 ... CH4, MATH1, ...) */
+#define MEAS_TDS_MAXSRC 8
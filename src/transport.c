@@ -0,0 +1,531 @@
+/*
+ * Instrument transports.
+ *
+ * A transport hides the bus an instrument is connected to, so that the same
+ * driver can talk to the instrument over GPIB, RS232 or a TCP socket
+ * (e.g. an LXI instrument on port 5025 or a serial to ethernet adapter).
+ * Each bus provides an ops table for writing a command (the terminator is
+ * added), reading a reply up to the terminator, reading N bytes, setting
+ * the timeout and flushing pending input.
+ *
+ *   t = meas_transport_tcp("192.168.1.10", MEAS_TRANSPORT_TCP_PORT);
+ *   meas_hp34401a_open_transport(0, t);
+ *
+ * RS232 and TCP share the buffered stream functions of serial.c.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "transport.h"
+#include "serial.h"
+#include "misc.h"
+#ifdef GPIB
+#include "gpib.h"
+#endif
+
+struct link;
+
+struct ops {
+  int (*write)(struct link *, char *, int);    /* write command + terminator */
+  int (*read)(struct link *, char *, int);     /* read reply up to terminator (max len) */
+  int (*read_n)(struct link *, char *, int);   /* read exactly N bytes */
+  int (*timeout)(struct link *, double);       /* set read timeout (s) */
+  int (*flush)(struct link *);                 /* discard pending input */
+  int (*close)(struct link *);
+};
+
+struct link {
+  struct ops *ops;                   /* NULL = free slot */
+  int type;                          /* MEAS_TRANSPORT_GPIB, ... */
+  int fd;                            /* GPIB device / RS232 port / socket */
+  int board;                         /* GPIB board */
+  char term[MEAS_TRANSPORT_TERMLEN]; /* command terminator */
+  int tlen;
+  char eos;                          /* reply terminator (stream transports) */
+  double timeout;                    /* read timeout (s), -1 = device default */
+};
+
+static struct link links[MEAS_TRANSPORT_MAX];
+
+static struct link *link_find(int t) {
+
+  if(t < 0 || t >= MEAS_TRANSPORT_MAX || !links[t].ops) return NULL;
+  return &links[t];
+}
+
+static int link_alloc(struct ops *ops, int type, int fd) {
+
+  int i;
+
+  for(i = 0; i < MEAS_TRANSPORT_MAX; i++)
+    if(!links[i].ops) break;
+  if(i == MEAS_TRANSPORT_MAX) return -1;
+  links[i].ops = ops;
+  links[i].type = type;
+  links[i].fd = fd;
+  links[i].board = -1;
+  links[i].tlen = 0;
+  links[i].eos = MEAS_SERIAL_EOS;
+  links[i].timeout = (type == MEAS_TRANSPORT_GPIB)?-1.0:MEAS_RS232_TIMEOUT;
+  return i;
+}
+
+#ifdef GPIB
+/* GPIB: terminator by meas_gpib_write_n(), reply ends at EOI (or EOS) */
+
+static int gpib_write(struct link *l, char *buf, int len) {
+
+  return meas_gpib_write_n(l->fd, buf, len, l->tlen == 2);
+}
+
+static int gpib_read(struct link *l, char *buf, int maxlen) {
+
+  return meas_gpib_read_max(l->fd, buf, maxlen);
+}
+
+static int gpib_read_n(struct link *l, char *buf, int len) {
+
+  return meas_gpib_read_n(l->fd, buf, len);
+}
+
+static int gpib_timeout(struct link *l, double timeout) {
+
+  return meas_gpib_timeout(l->fd, timeout);
+}
+
+static int gpib_flush(struct link *l) {
+
+  return meas_gpib_device_clear(l->fd);
+}
+
+static int gpib_close(struct link *l) {
+
+  return meas_gpib_close(l->board, l->fd);
+}
+
+static struct ops gpib_ops = {gpib_write, gpib_read, gpib_read_n, gpib_timeout, gpib_flush, gpib_close};
+#endif
+
+/* RS232 and TCP: buffered byte stream (serial.c) */
+
+static int stream_write(struct link *l, char *buf, int len) {
+
+  char tmp[MEAS_TRANSPORT_BUF_SIZE];
+
+  if(len + l->tlen > (int) sizeof(tmp)) {
+    if(meas_rs232_write(l->fd, buf, len) < 0) return -1;
+    return meas_rs232_write(l->fd, l->term, l->tlen);
+  }
+  /* one system call */
+  memcpy(tmp, buf, len);
+  memcpy(tmp + len, l->term, l->tlen);
+  return meas_rs232_write(l->fd, tmp, len + l->tlen);
+}
+
+static int stream_read(struct link *l, char *buf, int maxlen) {
+
+  int len, status;
+
+  len = meas_rs232_readeoc_dl(l->fd, buf, maxlen, l->eos, NULL, &status);
+  if(len < 0 || status != MEAS_RS232_OK)
+    meas_err("meas_transport_read: Read failed or timed out.");
+  while(len > 0 && (buf[len-1] == '\r' || buf[len-1] == '\n')) len--;
+  buf[len] = 0;
+  return len;
+}
+
+static int stream_read_n(struct link *l, char *buf, int len) {
+
+  return meas_rs232_read(l->fd, buf, len);
+}
+
+static int stream_timeout(struct link *l, double timeout) {
+
+  return meas_rs232_set_timeout(l->fd, timeout);
+}
+
+static int stream_flush(struct link *l) {
+
+  return meas_rs232_flush(l->fd);
+}
+
+static int stream_close(struct link *l) {
+
+  return meas_rs232_close(l->fd);
+}
+
+static struct ops stream_ops = {stream_write, stream_read, stream_read_n, stream_timeout, stream_flush, stream_close};
+
+/*
+ * Open GPIB transport.
+ *
+ * board = GPIB board # (0, 1, ...).
+ * dev   = GPIB ID.
+ * crlf  = Command terminator: 1 = CR LF, 0 = EOS character (see meas_gpib_write()).
+ *
+ * Returns transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_gpib(int board, int dev, int crlf) {
+
+#ifdef GPIB
+  int fd, t;
+
+  if((fd = meas_gpib_open(board, dev)) < 0) return -1;
+  if((t = link_alloc(&gpib_ops, MEAS_TRANSPORT_GPIB, fd)) < 0) {
+    meas_gpib_close(board, fd);
+    meas_err("meas_transport_gpib: Too many transports open.");
+  }
+  links[t].board = board;
+  links[t].tlen = meas_gpib_terminator(fd, links[t].term, crlf);
+  return t;
+#else
+  meas_err("meas_transport_gpib: libmeas was built without GPIB support.");
+#endif
+}
+
+/*
+ * Open RS232 transport. Commands are terminated with CR and replies are
+ * read up to CR (see meas_transport_terminator()).
+ *
+ * dev   = RS232 device (e.g. /dev/ttyS0).
+ * speed = Line speed (see meas_rs232_open()).
+ *
+ * Returns transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_rs232(char *dev, int speed) {
+
+  int fd, t;
+
+  if((fd = meas_rs232_open(dev, speed)) < 0) return -1;
+  if((t = link_alloc(&stream_ops, MEAS_TRANSPORT_RS232, fd)) < 0) {
+    meas_rs232_close(fd);
+    meas_err("meas_transport_rs232: Too many transports open.");
+  }
+  links[t].term[0] = MEAS_SERIAL_EOS;
+  links[t].tlen = 1;
+  return t;
+}
+
+/* Connect fd to addr within MEAS_TRANSPORT_TCP_CONNECT seconds */
+static int tcp_connect(int fd, struct sockaddr *addr, socklen_t len) {
+
+  struct pollfd pfd;
+  int err;
+  socklen_t elen = sizeof(err);
+
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  if(connect(fd, addr, len) < 0) {
+    if(errno != EINPROGRESS) return -1;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    if(poll(&pfd, 1, (int) (1000.0 * MEAS_TRANSPORT_TCP_CONNECT)) <= 0) return -1;
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0 || err) return -1;
+  }
+  fcntl(fd, F_SETFL, 0);
+  return 0;
+}
+
+/*
+ * Open raw TCP socket transport (SCPI over port 5025 on LXI instruments,
+ * serial to ethernet adapters, ...). Commands are terminated with LF and
+ * replies are read up to LF (see meas_transport_terminator()).
+ *
+ * host = Host name or address.
+ * port = TCP port (MEAS_TRANSPORT_TCP_PORT for LXI instruments).
+ *
+ * Returns transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_tcp(char *host, int port) {
+
+  struct addrinfo hints, *res, *ai;
+  char service[16], name[64];
+  int fd = -1, t, one = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  sprintf(service, "%d", port);
+  if(getaddrinfo(host, service, &hints, &res))
+    meas_err("meas_transport_tcp: Unknown host.");
+  for(ai = res; ai; ai = ai->ai_next) {
+    if((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0) continue;
+    if(!tcp_connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if(fd < 0) meas_err("meas_transport_tcp: Can't connect.");
+  /* commands are short and each one waits for a reply: send right away */
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  snprintf(name, sizeof(name), "%s:%d", host, port);
+  meas_rs232_attach(fd, name);
+  if((t = link_alloc(&stream_ops, MEAS_TRANSPORT_TCP, fd)) < 0) {
+    meas_rs232_close(fd);
+    meas_err("meas_transport_tcp: Too many transports open.");
+  }
+  links[t].term[0] = links[t].eos = '\n';
+  links[t].tlen = 1;
+  return t;
+}
+
+/*
+ * Set command and reply terminators (RS232 and TCP; GPIB terminators are
+ * set in meas_transport_gpib()).
+ *
+ * t    = Transport descriptor.
+ * term = Command terminator (e.g. "\r\n").
+ * eos  = Last character of replies.
+ *
+ */
+
+EXPORT int meas_transport_terminator(int t, char *term, char eos) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_terminator: Transport not open.");
+  if(l->type == MEAS_TRANSPORT_GPIB) meas_err("meas_transport_terminator: Not for GPIB.");
+  if(strlen(term) > MEAS_TRANSPORT_TERMLEN) meas_err("meas_transport_terminator: Terminator too long.");
+  l->tlen = strlen(term);
+  memcpy(l->term, term, l->tlen);
+  l->eos = eos;
+  return 0;
+}
+
+/*
+ * Close transport.
+ *
+ * t = Transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_close(int t) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_close: Transport not open.");
+  l->ops->close(l);
+  l->ops = NULL;
+  return 0;
+}
+
+/*
+ * Write command of given length (terminator is added).
+ *
+ * t   = Transport descriptor.
+ * buf = Command.
+ * len = Command length.
+ *
+ */
+
+EXPORT int meas_transport_write_n(int t, char *buf, int len) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_write: Transport not open.");
+  return l->ops->write(l, buf, len);
+}
+
+/*
+ * Write command (terminator is added).
+ *
+ * t   = Transport descriptor.
+ * cmd = Command (NUL terminated).
+ *
+ */
+
+EXPORT int meas_transport_write(int t, char *cmd) {
+
+  return meas_transport_write_n(t, cmd, strlen(cmd));
+}
+
+/*
+ * Write several commands. On RS232 and TCP they are sent with one system
+ * call; on GPIB each one is a separate message.
+ *
+ * t    = Transport descriptor.
+ * cmds = Commands (NUL terminated).
+ * n    = Number of commands.
+ *
+ */
+
+EXPORT int meas_transport_writev(int t, char **cmds, int n) {
+
+  struct link *l;
+  char tmp[MEAS_TRANSPORT_BUF_SIZE];
+  int i, len = 0, clen;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_writev: Transport not open.");
+  if(l->ops != &stream_ops) {
+    for(i = 0; i < n; i++)
+      if(l->ops->write(l, cmds[i], strlen(cmds[i])) < 0) return -1;
+    return 0;
+  }
+  for(i = 0; i < n; i++) {
+    clen = strlen(cmds[i]);
+    if(len + clen + l->tlen > (int) sizeof(tmp)) meas_err("meas_transport_writev: Commands too long.");
+    memcpy(tmp + len, cmds[i], clen);
+    memcpy(tmp + len + clen, l->term, l->tlen);
+    len += clen + l->tlen;
+  }
+  return meas_rs232_write(l->fd, tmp, len);
+}
+
+/*
+ * Read reply (up to the terminator or EOI). The terminator (and trailing
+ * CR/LF) is removed.
+ *
+ * t      = Transport descriptor.
+ * buf    = Buffer for the reply (NUL terminated).
+ * maxlen = Size of buf.
+ *
+ * Returns reply length.
+ *
+ */
+
+EXPORT int meas_transport_read(int t, char *buf, int maxlen) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_read: Transport not open.");
+  return l->ops->read(l, buf, maxlen);
+}
+
+/*
+ * Read exactly len bytes (binary data).
+ *
+ * t   = Transport descriptor.
+ * buf = Buffer for data.
+ * len = Number of bytes.
+ *
+ */
+
+EXPORT int meas_transport_read_n(int t, char *buf, int len) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_read_n: Transport not open.");
+  return l->ops->read_n(l, buf, len);
+}
+
+/*
+ * Write command and read reply.
+ *
+ * t      = Transport descriptor.
+ * cmd    = Command.
+ * buf    = Buffer for the reply (NUL terminated).
+ * maxlen = Size of buf.
+ *
+ * Returns reply length.
+ *
+ */
+
+EXPORT int meas_transport_query(int t, char *cmd, char *buf, int maxlen) {
+
+  if(meas_transport_write(t, cmd) < 0) {
+    buf[0] = 0;
+    return -1;
+  }
+  return meas_transport_read(t, buf, maxlen);
+}
+
+/*
+ * Set read timeout.
+ *
+ * t       = Transport descriptor.
+ * timeout = Timeout in seconds.
+ *
+ */
+
+EXPORT int meas_transport_timeout(int t, double timeout) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_timeout: Transport not open.");
+  if(l->ops->timeout(l, timeout) < 0) return -1;
+  l->timeout = timeout;
+  return 0;
+}
+
+/*
+ * Get the read timeout set with meas_transport_timeout(), so that it
+ * can be restored after a long transfer.
+ *
+ * t       = Transport descriptor.
+ * timeout = Timeout in seconds, -1 for the GPIB device default (never set).
+ *
+ * Returns zero on success.
+ *
+ */
+
+EXPORT int meas_transport_get_timeout(int t, double *timeout) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_get_timeout: Transport not open.");
+  *timeout = l->timeout;
+  return 0;
+}
+
+/*
+ * Discard pending input (GPIB: device clear).
+ *
+ * t = Transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_flush(int t) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_flush: Transport not open.");
+  return l->ops->flush(l);
+}
+
+/*
+ * Return transport type (MEAS_TRANSPORT_GPIB, MEAS_TRANSPORT_RS232 or
+ * MEAS_TRANSPORT_TCP).
+ *
+ * t = Transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_type(int t) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_type: Transport not open.");
+  return l->type;
+}
+
+/*
+ * Return the underlying descriptor (GPIB device, RS232 port or socket),
+ * e.g. for meas_gpib_trigger().
+ *
+ * t = Transport descriptor.
+ *
+ */
+
+EXPORT int meas_transport_fd(int t) {
+
+  struct link *l;
+
+  if(!(l = link_find(t))) meas_err("meas_transport_fd: Transport not open.");
+  return l->fd;
+}
@@ -0,0 +1,24 @@
+/*
+ * Instrument transports (GPIB, RS232, TCP).
+ *
+ */
+
+/* Transport types */
+#define MEAS_TRANSPORT_GPIB  0
+#define MEAS_TRANSPORT_RS232 1
+#define MEAS_TRANSPORT_TCP   2
+
+/* Maximum number of open transports */
+#define MEAS_TRANSPORT_MAX 32
+
+/* Reply buffer size used by the drivers */
+#define MEAS_TRANSPORT_BUF_SIZE 512
+
+/* Maximum length of the command terminator */
+#define MEAS_TRANSPORT_TERMLEN 4
+
+/* Default port for raw socket SCPI (LXI instruments) */
+#define MEAS_TRANSPORT_TCP_PORT 5025
+
+/* Connect timeout for TCP (s) */
+#define MEAS_TRANSPORT_TCP_CONNECT 5.0
@@ -119,7 +119,6 @@ static void destroy_buffers(int cd) {
   struct v4l2_buffer buf;
   int i;
   
-  meas_misc_root_on();
   bzero(&buf, sizeof(buf));
   buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   buf.memory = V4L2_MEMORY_MMAP;
@@ -140,7 +139,6 @@ static void destroy_buffers(int cd) {
   
   free(devices[cd].buffer_lengths);
   free(devices[cd].buffers);
-  meas_misc_root_off();
 }
 
 static void setup_buffers(int cd, int nbuf) {
@@ -352,7 +350,9 @@ EXPORT int meas_video_open(char *device, int nbuffers) {
   cd = i;
 
   meas_misc_root_on();
-  if((fd = open(device, O_RDWR | O_NONBLOCK, 0)) < 0) {
+  fd = open(device, O_RDWR | O_NONBLOCK, 0);
+  meas_misc_root_off();   /* everything else goes through the descriptor */
+  if(fd < 0) {
     fprintf(stderr, "libmeas: Can't open video device.\n");
     return -1;
   }
@@ -393,8 +393,6 @@ EXPORT int meas_video_open(char *device, int nbuffers) {
   devices[cd].camera_state = 1; /* Make sure we stop streaming */
   meas_video_stop(cd);
 
-  meas_misc_root_off();
-  
   return cd;
 }
 /*
@@ -784,7 +782,6 @@ EXPORT int meas_video_start(int cd) {
   }
   if(devices[cd].camera_state) return -1; /* camera already streaming */
   
-  meas_misc_root_on();
   /* Insert buffers into queue */
   for(i = 0; i < devices[cd].buffer_info.count; i++) {
     bzero(&buf, sizeof(buf));
@@ -802,7 +799,6 @@ EXPORT int meas_video_start(int cd) {
     fprintf(stderr, "libmeas: error in ioctl(VIDIOC_STREAMON).\n");
     return -1;
   }
-  meas_misc_root_off();
   devices[cd].camera_state = 1;
 }
 
@@ -825,11 +821,9 @@ EXPORT int meas_video_stop(int cd) {
   }
   if(!devices[cd].camera_state) return -1; /* camera already stopped */
 
-  meas_misc_root_on();
   /* stop capturing */
   type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   ioctl(devices[cd].fd, VIDIOC_STREAMOFF, &type);
-  meas_misc_root_off();
   devices[cd].camera_state = 0;
 }
 
@@ -851,9 +845,7 @@ EXPORT int meas_video_close(int cd) {
     return -1;
   }
 
-  meas_misc_root_on();
   meas_video_stop(cd);
-  meas_misc_root_off();
 
   for (i = 0; i < devices[cd].nframe_formats; i++)
     free(devices[cd].frame_formats[i]);
@@ -863,10 +855,8 @@ EXPORT int meas_video_close(int cd) {
       free(devices[cd].frame_sizes[i][j]);
   
   // unmap buffers & free
-  meas_misc_root_on();
   for (i = 0; i < devices[cd].buffer_info.count; i++)
     munmap(devices[cd].buffers[i], devices[cd].buffer_lengths[i]);
-  meas_misc_root_off();
   free(devices[cd].buffer_lengths);
   free(devices[cd].buffers);
     
@@ -904,7 +894,6 @@ EXPORT int meas_video_read(int cd, unsigned char *buffer, int nframes) {
     fprintf(stderr, "libmeas: Attempt to read video device without opening.");
     return -1;
   }
-  meas_misc_root_on();
 
   bzero(buffer, devices[cd].current_format.fmt.pix.sizeimage * nframes);
   
@@ -945,7 +934,6 @@ EXPORT int meas_video_read(int cd, unsigned char *buffer, int nframes) {
       return -1;
     }
   }
-  meas_misc_root_off();
   return 0;
 }
 
@@ -971,7 +959,6 @@ EXPORT int meas_video_flush(int cd) {
     fprintf(stderr, "libmeas: Attempt to read video device without opening.");
     return -1;
   }
-  meas_misc_root_on();
 
   for (i = 0; i < devices[cd].buffer_info.count; i++) {
     bzero(&buf, sizeof(buf));
@@ -990,7 +977,6 @@ EXPORT int meas_video_flush(int cd) {
       return -1;
     }
   }
-  meas_misc_root_off();
   return 0;
 }
 
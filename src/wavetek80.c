@@ -15,19 +15,36 @@
 #include <unistd.h>
 #include "wavetek80.h"
 #include "gpib.h"
+#include "shadow.h"
 #include "misc.h"
 
 /* Up to 5 devices supported */
 static int wavetek80_fd[5] = {-1, -1, -1, -1, -1};
+static int wavetek80_shadow[5] = {-1, -1, -1, -1, -1};
+
+/* Send a setting unless the unit already has it (the command letters identify the setting) */
+static int set(int unit, char *cmd) {
+
+  int keylen = strspn(cmd, "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+
+  if(!meas_shadow_update(wavetek80_shadow[unit], cmd, keylen)) return 0;
+  if(meas_gpib_write(wavetek80_fd[unit], cmd, 0) < 0) {
+    meas_shadow_forget(wavetek80_shadow[unit], cmd, keylen);
+    return -1;
+  }
+  return 0;
+}
 
 EXPORT int meas_wavetek80_open(int unit, int board, int dev) {
   
   if(wavetek80_fd[unit] == -1) {
     wavetek80_fd[unit] = meas_gpib_open(board, dev);
     meas_gpib_timeout(wavetek80_fd[unit], 1.0);
+    wavetek80_shadow[unit] = meas_shadow_open();
   }
-  meas_gpib_write(wavetek80_fd[unit], "X0", 0); /* response header off */
-  meas_gpib_write(wavetek80_fd[unit], "Z0", 0); /* Newline + EOI terminator */
+  meas_shadow_invalidate(wavetek80_shadow[unit]);
+  set(unit, "X0"); /* response header off */
+  set(unit, "Z0"); /* Newline + EOI terminator */
   return 0;
 }
 
@@ -50,7 +67,7 @@ EXPORT int meas_wavetek80_operating_mode(int unit, int mode) {
     meas_err("wavetek80: Invalid operating mode.");
 
   sprintf(buf, "F%d", mode);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -73,7 +90,7 @@ EXPORT int meas_wavetek80_sweep_direction(int unit, int dir) {
     meas_err("wavetek80: Invalid sweep mode.");
 
   sprintf(buf, "S%d", dir );
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -99,7 +116,7 @@ EXPORT int meas_wavetek80_trigger_mode(int unit, int mode) {
     meas_err("wavetek80: Invalid trigger mode.");
 
   sprintf(buf, "M%d", mode);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -122,7 +139,7 @@ EXPORT int meas_wavetek80_control_mode(int unit, int mode) {
     meas_err("wavetek80: Invalid control mode.");
 
   sprintf(buf, "CT%d", mode);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -147,7 +164,7 @@ EXPORT int meas_wavetek80_output_waveform(int unit, int mode) {
     meas_err("wavetek80: Invalid waveform.");
 
   sprintf(buf, "W%d", mode);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -168,7 +185,7 @@ EXPORT int meas_wavetek80_output_mode(int unit, int mode) {
     meas_err("wavetek80: Invalid output mode.");
 
   sprintf(buf, "D%d", mode);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -185,7 +202,7 @@ EXPORT int meas_wavetek80_set_frequency(int unit, double freq) {
   if(freq < 10E-3 || freq > 50E6) meas_err("wavetek80: Illegal frequency setting.");
 
   sprintf(buf, "FRQ %leHZ", freq);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -218,7 +235,7 @@ EXPORT int meas_wavetek80_set_amplitude(int unit, double ampl) {
   if(ampl < 10E-3 || ampl > 16.0) meas_err("wavetek80: Illegal amplitude setting.");
 
   sprintf(buf, "AMP %leV", ampl);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -251,7 +268,7 @@ EXPORT int meas_wavetek80_set_offset(int unit, double offset) {
   if(offset < -8.0 || offset > 8.0) meas_err("wavetek80: Illegal offset setting.");
 
   sprintf(buf, "OFS %leV", offset);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -284,7 +301,7 @@ EXPORT int meas_wavetek80_set_phase_lock_offset(int unit, double offset) {
   if(offset < -180.0 || offset > 180.0) meas_err("wavetek80: Illegal phase lock offset setting.");
 
   sprintf(buf, "PLL %le", offset);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -317,7 +334,7 @@ EXPORT int meas_wavetek80_set_internal_trigger_interval(int unit, double ival) {
   if(ival < 20E-6 || ival > 999.0) meas_err("wavetek80: Illegal trigger interval setting.");
 
   sprintf(buf, "RPT %le", ival);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -349,8 +366,8 @@ EXPORT int meas_wavetek80_set_counted_burst(int unit, int nburst) {
   if(wavetek80_fd[unit] == -1) meas_err("wavetek80: non-existent unit.");
   if(nburst < 1 || nburst > 4000) meas_err("wavetek80: Illegal counted burst setting.");
 
-  sprintf(buf, "BUR %le", nburst);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  sprintf(buf, "BUR %d", nburst);
+  set(unit, buf);
   return 0;
 }
 
@@ -384,7 +401,7 @@ EXPORT int meas_wavetek80_set_trigger_level(int unit, double level) {
   if(level < -10.0 || level > 10.0) meas_err("wavetek80: Illegal trigger level setting.");
 
   sprintf(buf, "TLV %le", level);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -417,7 +434,7 @@ EXPORT int meas_wavetek80_set_trigger_phase_offset(int unit, double offset) {
   if(offset < -90.0 || offset > 90.0) meas_err("wavetek80: Illegal trigger phase offset setting.");
 
   sprintf(buf, "TPH %le", offset);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -451,7 +468,7 @@ EXPORT int meas_wavetek80_set_output_level(int unit, double level) {
   if(level < -8.0 || level > 8.0) meas_err("wavetek80: Illegal output level setting.");
 
   sprintf(buf, "DCO %leV", level);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -485,7 +502,7 @@ EXPORT int meas_wavetek80_set_log_sweep_stop(int unit, double value) {
   if(value < 10.0E-3 || value > 50.0E6) meas_err("wavetek80: Illegal log sweep stop setting.");
 
   sprintf(buf, "STP %leHZ", value);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -518,7 +535,7 @@ EXPORT int meas_wavetek80_set_sweep_time(int unit, double value) {
   if(value < 10.0E-3 || value > 999.0) meas_err("wavetek80: Illegal sweep time setting.");
 
   sprintf(buf, "SWT %leS", value);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -551,7 +568,7 @@ EXPORT int meas_wavetek80_set_log_sweep_marker(int unit, double value) {
   if(value < 10E-3 || value > 50.0E6) meas_err("wavetek80: Illegal log sweep marker setting.");
 
   sprintf(buf, "MRK %leHZ", value);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -584,7 +601,7 @@ EXPORT int meas_wavetek80_set_sweep_stop(int unit, int value) {
   if(value < 10 || value > 5000) meas_err("wavetek80: Illegal sweep stop setting.");
 
   sprintf(buf, "SSN %d", value);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  set(unit, buf);
   return 0;
 }
 
@@ -616,8 +633,8 @@ EXPORT int meas_wavetek80_set_sweep_marker(int unit, int value) {
   if(wavetek80_fd[unit] == -1) meas_err("wavetek80: non-existent unit.");
   if(value < 10 || value > 5000) meas_err("wavetek80: Illegal sweep marker setting.");
 
-  sprintf(buf, "MKN %leHZ", value);
-  meas_gpib_write(wavetek80_fd[unit], buf, 0);
+  sprintf(buf, "MKN %dHZ", value);
+  set(unit, buf);
   return 0;
 }
 
@@ -637,4 +654,16 @@ EXPORT int meas_wavetek80_get_sweep_marker(int unit) {
   return atoi(buf);
 }
 
+/*
+ * Forget the settings sent to the unit, so that they are all sent again
+ * (call after changing settings on the front panel).
+ *
+ */
+
+EXPORT int meas_wavetek80_invalidate(int unit) {
+
+  if(wavetek80_fd[unit] == -1) meas_err("wavetek80: non-existent unit.");
+  return meas_shadow_invalidate(wavetek80_shadow[unit]);
+}
+
 #endif /* GPIB */